@@ -0,0 +1,251 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "brainfuck.h"
+
+/* Benchmark of machine over fixed corpus of examples
+ * Every program is compiled and executed runs times with
+ * canned input, medians of times are reported. Count of
+ * executed instructions is taken from one profiled run.
+ * Results are printed as table and written as JSON. */
+
+typedef struct bench_case {
+    const char* file;
+    const char* input;
+    bft_error expect; /* result of complete run */
+} bench_case;
+
+static const bench_case corpus[] = {
+    { "mandelbrot.bf",   "", BFE_OK },
+    { "hanoi.bf",        "", BFE_OK },
+    { "factor.bf",       "1234567890123\n", BFE_OK },
+    // prints digits of e until end of default memory
+    { "e.bf",            "", BFE_MEMORY_CORRUPTION },
+    { "lost-kingdom.bf",
+        "n\n" "look\n" "?\n" "inventory\n" "north\n" "look\n" "get lamp\n"
+        "inventory\n" "examine lamp\n" "score\n" "quit\n" "y\n" "n\n", BFE_OK },
+    { "game-of-life.bf", "\n" "\n" "\n" "q\n", BFE_OK },
+};
+
+enum { BENCH_CASES = sizeof corpus / sizeof *corpus };
+
+typedef struct bench_io {
+    const char* input;
+    size_t input_size, position;
+    size_t output_size;
+    uint64_t output_hash;
+} bench_io;
+
+static void bench_read(void* data, bft_cell* cell) {
+    bench_io* io = data;
+    *cell = io->position < io->input_size ? io->input[io->position++] : 0;
+}
+
+static size_t bench_read_block(void* data, bft_cell* cells, size_t count) {
+    bench_io* io = data;
+    size_t left = io->input_size - io->position;
+    if (count > left) count = left;
+    memcpy(cells, io->input + io->position, count);
+    io->position += count;
+    return count;
+}
+
+static void bench_write_block(void* data, const bft_cell* cells, size_t count) {
+    bench_io* io = data;
+    io->output_size += count;
+    for (size_t i = 0; i < count; i++) {
+        io->output_hash ^= cells[i];
+        io->output_hash *= 0x100000001B3ull;
+    }
+}
+
+static void bench_write(void* data, bft_cell cell) {
+    bench_write_block(data, &cell, 1);
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_times(const void* lhs, const void* rhs) {
+    double ltime = *(const double*)lhs, rtime = *(const double*)rhs;
+    return (ltime > rtime) - (ltime < rtime);
+}
+
+static double median(double* times, size_t count) {
+    qsort(times, count, sizeof *times, compare_times);
+    return count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+}
+
+static char* read_file(const char* dir, const char* name, size_t* size) {
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    char* data = NULL; long length;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0
+            && fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length + 1))) {
+        *size = fread(data, 1, length, file);
+        data[*size] = '\0';
+    }
+    fclose(file);
+    return data;
+}
+
+typedef struct bench_result {
+    const char* name;
+    bft_error rc;
+    bool stable; /* same output in every run */
+    double compile_time, execute_time, execute_min;
+    uint64_t instructions;
+    size_t output_size;
+} bench_result;
+
+static bft_error bench_run(const bench_case* test, bft_program* program, bft_jit* jit,
+        uint64_t* counts, bench_io* io) {
+    *io = (bench_io){ test->input, strlen(test->input), 0, 0, 0xCBF29CE484222325ull };
+    bft_env env = {
+        io, io,
+        bench_read, bench_write,
+        bench_read_block, bench_write_block
+    };
+    bft_context context = {0};
+    bft_error rc;
+    do {
+        rc = jit ? bfa_jit_execute(jit, &env, &context)
+            : counts ? bfa_profile(program, &env, &context, counts)
+            : bfa_execute(program, &env, &context);
+    } while (rc == BFE_BREAKPOINT);
+    return rc;
+}
+
+static bench_result bench(const bench_case* test, const char* dir, size_t runs, bool use_jit) {
+    bench_result result = { test->file, BFE_OK, true, 0, 0, 0, 0, 0 };
+    double* times = malloc(runs * sizeof *times);
+    size_t size = 0;
+    char* code = read_file(dir, test->file, &size);
+    if (!code || !times) {
+        result.rc = code ? BFE_NO_MEMORY : BFE_FILE_ERROR;
+        free(code); free(times);
+        return result;
+    }
+
+    bft_program program = {0};
+    for (size_t i = 0; i < runs && !result.rc; i++) {
+        bfa_destroy(&program);
+        program = (bft_program){0};
+        double start = bench_now();
+        result.rc = bfa_compile(&program, code, size);
+        times[i] = bench_now() - start;
+    }
+    free(code);
+    if (result.rc) { free(times); return result; }
+    result.compile_time = median(times, runs);
+
+    bft_jit jit = {0};
+    if (use_jit && (result.rc = bfa_jit_compile(&jit, &program))) {
+        bfa_destroy(&program);
+        free(times);
+        return result;
+    }
+
+    bench_io io;
+    uint64_t hash = 0;
+    for (size_t i = 0; i < runs; i++) {
+        double start = bench_now();
+        bft_error rc = bench_run(test, &program, use_jit ? &jit : NULL, NULL, &io);
+        times[i] = bench_now() - start;
+        if (i == 0) { result.rc = rc; hash = io.output_hash; result.output_size = io.output_size; }
+        else if (rc != result.rc || io.output_hash != hash) result.stable = false;
+    }
+    result.execute_time = median(times, runs);
+    result.execute_min = times[0];
+    if (result.rc == test->expect) result.rc = BFE_OK;
+
+    uint64_t* counts = calloc(program.count, sizeof *counts);
+    if (counts) {
+        bench_run(test, &program, NULL, counts, &io);
+        for (size_t i = 0; i < program.count; i++)
+            result.instructions += counts[i];
+    }
+
+    free(counts);
+    bfa_jit_destroy(&jit);
+    bfa_destroy(&program);
+    free(times);
+    return result;
+}
+
+static void write_json(FILE* dest, const bench_result* results, size_t count, size_t runs, bool use_jit) {
+    fprintf(dest, "{\n  \"mode\": \"%s\",\n  \"runs\": %zu,\n  \"results\": [\n",
+        use_jit ? "jit" : "interpreter", runs);
+    for (size_t i = 0; i < count; i++) {
+        const bench_result* r = results + i;
+        fprintf(dest, "    { \"name\": \"%s\", \"result\": \"%s\", \"stable\": %s,\n",
+            r->name, bfa_strerror(r->rc), r->stable ? "true" : "false");
+        fprintf(dest, "      \"compile_ms\": %.6f, \"execute_ms\": %.6f, \"execute_min_ms\": %.6f,\n",
+            r->compile_time * 1e3, r->execute_time * 1e3, r->execute_min * 1e3);
+        fprintf(dest, "      \"instructions\": %llu, \"instructions_per_sec\": %.0f,\n",
+            (unsigned long long)r->instructions,
+            r->execute_time > 0 ? r->instructions / r->execute_time : 0.0);
+        fprintf(dest, "      \"output_bytes\": %zu, \"output_bytes_per_sec\": %.0f }%s\n",
+            r->output_size, r->execute_time > 0 ? r->output_size / r->execute_time : 0.0,
+            i + 1 < count ? "," : "");
+    }
+    fprintf(dest, "  ]\n}\n");
+}
+
+static void usage(const char* exename) {
+    fprintf(stderr, "usage: %s [-J] [-n <runs>] [-d <examples>] [-o <results.json>]\n", exename);
+    fprintf(stderr, "  -J   Compile programs to native code before execution\n");
+    fprintf(stderr, "  -n   Count of runs of every program (default: 5)\n");
+    fprintf(stderr, "  -d   Directory of example programs (default: examples)\n");
+    fprintf(stderr, "  -o   File of results in JSON (default: bfbench.json)\n");
+}
+
+int main(int argc, char** argv) {
+    const char *dir = "examples", *output = "bfbench.json";
+    size_t runs = 5;
+    bool use_jit = false;
+
+    for (int i = 1; i < argc; i++) {
+        /**/ if (strcmp(argv[i], "-J") == 0) use_jit = true;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) dir = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+        else { usage(argv[0]); return EXIT_FAILURE; }
+    }
+
+    bench_result results[BENCH_CASES];
+    int failed = 0;
+    printf("%-16s %10s %10s %10s %14s %10s %12s  %s\n", "program", "compile ms",
+        "median ms", "min ms", "instructions", "MIPS", "output B/s", "result");
+    for (size_t i = 0; i < BENCH_CASES; i++) {
+        bench_result* r = results + i;
+        *r = bench(corpus + i, dir, runs, use_jit);
+        printf("%-16s %10.3f %10.3f %10.3f %14llu %10.1f %12.0f  %s%s\n", r->name,
+            r->compile_time * 1e3, r->execute_time * 1e3, r->execute_min * 1e3,
+            (unsigned long long)r->instructions,
+            r->execute_time > 0 ? r->instructions / r->execute_time / 1e6 : 0.0,
+            r->execute_time > 0 ? r->output_size / r->execute_time : 0.0,
+            bfa_strerror(r->rc), r->stable ? "" : " (unstable output)");
+        if (r->rc || !r->stable) failed = 1;
+    }
+
+    FILE* dest = fopen(output, "w");
+    if (!dest) {
+        fprintf(stderr, "cannot open %s\n", output);
+        return EXIT_FAILURE;
+    }
+    write_json(dest, results, BENCH_CASES, runs, use_jit);
+    fclose(dest);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
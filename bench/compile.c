@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "brainfuck.h"
+
+/* Compilation throughput in megabytes of source per second
+ * Every source is compiled repeatedly during BENCH_TIME
+ * seconds (at least BENCH_MIN_RUNS times), fastest run is
+ * reported. Without arguments large bundled examples and
+ * generated sources with many long loops are measured. */
+
+#define BENCH_TIME 0.5
+#define BENCH_MIN_RUNS 3
+
+static const char* default_files[] = {
+    "examples/lost-kingdom.bf",
+    "examples/text.bf",
+    "examples/hanoi.bf",
+    "examples/bfbf.bf",
+};
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char* read_file(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    char* data = NULL; long length;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0
+            && fseek(file, 0, SEEK_SET) == 0 && (data = malloc(length + 1))) {
+        *size = fread(data, 1, length, file);
+        data[*size] = '\0';
+    }
+    fclose(file);
+    return data;
+}
+
+/* Append count copies of text, returns new size */
+static size_t append(char* dest, size_t size, const char* text, size_t count) {
+    size_t length = strlen(text);
+    for (size_t i = 0; i < count; i++, size += length)
+        memcpy(dest + size, text, length);
+    return size;
+}
+
+/* Loops nested into each other, each one longer
+ * than short jump, so every closing bracket makes
+ * opening jump long */
+static char* nested_loops(size_t depth, size_t* size) {
+    const char* body = "+>+<";
+    size_t repeat = 1500;
+    char* code = malloc(depth * (strlen(body) * repeat + 3) + 2);
+    if (!code) return NULL;
+
+    *size = append(code, 0, "+", 1);
+    for (size_t i = 0; i < depth; i++) {
+        *size = append(code, *size, "[", 1);
+        *size = append(code, *size, body, repeat);
+    }
+    *size = append(code, *size, "-]", depth);
+    code[*size] = '\0';
+    return code;
+}
+
+/* Long loops before first instruction, which
+ * are never executed and removed by compiler */
+static char* leading_loops(size_t count, size_t* size) {
+    const char* body = "+>+<";
+    size_t repeat = 1500;
+    char* code = malloc(count * (strlen(body) * repeat + 2) + 2);
+    if (!code) return NULL;
+
+    *size = 0;
+    for (size_t i = 0; i < count; i++) {
+        *size = append(code, *size, "[", 1);
+        *size = append(code, *size, body, repeat);
+        *size = append(code, *size, "]", 1);
+    }
+    *size = append(code, *size, ".", 1);
+    code[*size] = '\0';
+    return code;
+}
+
+static int bench(const char* name, const char* code, size_t size) {
+    double best = 0, total = 0;
+    size_t runs = 0, words = 0;
+
+    while (runs < BENCH_MIN_RUNS || total < BENCH_TIME) {
+        bft_program program = {0};
+        double start = bench_now();
+        bft_error rc = bfa_compile(&program, code, size);
+        double time = bench_now() - start;
+        if (rc) {
+            fprintf(stderr, "%s: %s\n", name, bfa_strerror(rc));
+            return 1;
+        }
+        words = program.count;
+        bfa_destroy(&program);
+
+        if (runs == 0 || time < best) best = time;
+        total += time; ++runs;
+    }
+
+    printf("%-28s %10zu %10zu %6zu %10.3f %10.2f\n", name, size, words,
+        runs, best * 1e3, size / best / (1 << 20));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    printf("%-28s %10s %10s %6s %10s %10s\n",
+        "source", "bytes", "words", "runs", "best ms", "MB/s");
+
+    const char** files = (const char**)argv + 1;
+    size_t count = argc - 1;
+    if (count == 0) {
+        files = default_files;
+        count = sizeof default_files / sizeof *default_files;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t size = 0;
+        char* code = read_file(files[i], &size);
+        if (!code) {
+            fprintf(stderr, "%s: cannot load file content\n", files[i]);
+            failed = 1;
+            continue;
+        }
+        failed |= bench(files[i], code, size);
+        free(code);
+    }
+
+    if (argc > 1) return failed;
+
+    struct { const char* name; char* (*generate)(size_t, size_t*); size_t arg; } generated[] = {
+        { "<nested long loops x1000>", nested_loops, 1000 },
+        { "<leading long loops x500>", leading_loops, 500 },
+    };
+    for (size_t i = 0; i < sizeof generated / sizeof *generated; i++) {
+        size_t size = 0;
+        char* code = generated[i].generate(generated[i].arg, &size);
+        if (!code) { failed = 1; continue; }
+        failed |= bench(generated[i].name, code, size);
+        free(code);
+    }
+    return failed;
+}
@@ -7,8 +7,13 @@
 
 #ifdef _WIN32
 #define PATH_DELIM '\\'
+#include <process.h>
+#define getpid _getpid
 #else
 #define PATH_DELIM '/'
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #define  INFO_PREFIX "[\x1b[34mINFO\x1b[0m]: "
@@ -16,6 +21,8 @@
 #define USAGE_PREFIX "[\x1b[32mUSAGE\x1b[0m]: "
 #define  WARN_PREFIX "[\x1b[33mWARNING\x1b[0m]: "
 
+#define EVAL_STEPS 10000000 // limit of evaluation of program start
+
 static char* read_file(const char* filename) {
     long size; char* data = NULL;
 
@@ -37,10 +44,204 @@ cleanup:
     return data;
 }
 
+static const char* with_extension(const char* path, const char* ext) {
+    static char ext_path[272] = {0};
+    strcpy(ext_path, path);
+    char* ext_dot = strrchr(ext_path, '.');
+    if (ext_dot && strcmp(ext_dot, ".bf") == 0)
+        strcpy(ext_dot, ext);
+    else
+        strcat(ext_path, ext);
+    return ext_path;
+}
+
 static void usage(const char* exename) {
     fprintf(stderr, USAGE_PREFIX "\n  %s <code.bf> [OPTIONS] [<input.txt>]\n", exename);
+    fprintf(stderr, "  %s - [OPTIONS] [<input.txt>]   (code from standard input)\n", exename);
     fprintf(stderr, "OPTIONS:\n");
     fprintf(stderr, "  -A   Write to <code.bfa> instructions for machine\n");
+    fprintf(stderr, "  -C   Write to <code.c> equivalent C source code\n");
+    fprintf(stderr, "  -J   Compile instructions to native code before execution\n");
+    fprintf(stderr, "  -E   Evaluate start of program before first input at compile time\n");
+    fprintf(stderr, "  -W   Run program of wide instructions (not with -J, -P and batch)\n");
+    fprintf(stderr, "  -O<level>\n");
+    fprintf(stderr, "       Level of optimizations from 0 to 3 (default: %d)\n", BFD_OPT_LEVEL);
+    fprintf(stderr, "  -P   Write to <code.bfa> instructions with counts of their runs\n");
+    fprintf(stderr, "       and hottest loops (code is not compiled to native)\n");
+    fprintf(stderr, "  -M <cells>[K|M]\n");
+    fprintf(stderr, "       Run on guarded memory of given size\n");
+    fprintf(stderr, "  --batch <dir>\n");
+    fprintf(stderr, "       Run on every file of directory as input,\n");
+    fprintf(stderr, "       output is written to <file>.out near it\n");
+    fprintf(stderr, "  -j <count>\n");
+    fprintf(stderr, "       Count of threads in batch mode (default: all processors)\n");
+    fprintf(stderr, "  --stats[=json]\n");
+    fprintf(stderr, "       Print counters of execution at exit, as text or JSON\n");
+    fprintf(stderr, "       (code is run by interpreter only)\n");
+    fprintf(stderr, "  --no-cache\n");
+    fprintf(stderr, "       Compile code without cache of compiled programs\n");
+}
+
+/* Code is compiled while it is read, without cache */
+static bft_error compile_stream(bft_program* program, FILE* file, int level, bool evaluate) {
+    static char chunk[65536];
+    bft_compiler compiler;
+    bft_error rc = bfa_compile_begin(&compiler);
+    if (rc) return rc;
+    compiler.level = level;
+
+    size_t count;
+    while (!rc && (count = fread(chunk, 1, sizeof chunk, file)) > 0)
+        rc = bfa_compile_feed(&compiler, chunk, count);
+    rc = bfa_compile_end(&compiler, program);
+    if (rc == BFE_OK && evaluate) rc = bfa_evaluate(program, EVAL_STEPS);
+    return rc;
+}
+
+static bool parse_size(const char* text, size_t* size) {
+    char* end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return false;
+    /**/ if (*end == 'K' || *end == 'k') value <<= 10, ++end;
+    else if (*end == 'M' || *end == 'm') value <<= 20, ++end;
+    if (*end != '\0' || value == 0 || value > SIZE_MAX) return false;
+    *size = value;
+    return true;
+}
+
+typedef struct bf_inputs {
+    const char* dir;
+    char** names;
+    bft_error* results;
+    size_t count;
+} bf_inputs;
+
+static char* join_path(const char* dir, const char* name, const char* ext) {
+    size_t size = strlen(dir) + strlen(name) + strlen(ext) + 2;
+    char* path = malloc(size);
+    if (path) snprintf(path, size, "%s%c%s%s", dir, PATH_DELIM, name, ext);
+    return path;
+}
+
+/* Compiled programs are cached in $XDG_CACHE_HOME/bf
+ * or ~/.cache/bf, file name is hash of source code */
+static char* cache_path(uint64_t hash) {
+#ifdef _WIN32
+    (void)hash;
+    return NULL;
+#else
+    const char* base = getenv("XDG_CACHE_HOME");
+    char* cache = base && *base ? join_path(base, "", "") : NULL;
+    if (!cache) {
+        base = getenv("HOME");
+        if (!base || !*base) return NULL;
+        cache = join_path(base, ".cache", "");
+        if (!cache) return NULL;
+    }
+    mkdir(cache, 0755);
+    char* dir = join_path(cache, "bf", "");
+    free(cache);
+    if (!dir) return NULL;
+    mkdir(dir, 0755);
+
+    char name[17];
+    snprintf(name, sizeof name, "%016llx", (unsigned long long)hash);
+    char* path = join_path(dir, name, ".bfc");
+    free(dir);
+    return path;
+#endif
+}
+
+static bft_error compile(bft_program* program, const char* code, size_t size, int level, bool evaluate) {
+    bft_compiler compiler;
+    bft_error rc = bfa_compile_begin(&compiler);
+    if (rc) return rc;
+    compiler.level = level;
+    bfa_compile_feed(&compiler, code, size);
+    rc = bfa_compile_end(&compiler, program);
+    if (rc == BFE_OK && evaluate) rc = bfa_evaluate(program, EVAL_STEPS);
+    return rc;
+}
+
+static bft_error load_program(bft_program* program, const char* code, bool use_cache, int level, bool evaluate) {
+    size_t size = strlen(code);
+    if (!use_cache) return compile(program, code, size, level, evaluate);
+
+    uint64_t hash = bfa_hash(code, size), cached = 0;
+    if (evaluate) hash = ~hash; // evaluated programs are kept apart
+    hash ^= (uint64_t)level << 56; // so are levels of optimizations
+    char* path = cache_path(hash);
+    if (path && bfa_load(program, &cached, path) == BFE_OK) {
+        if (cached == hash) { free(path); return BFE_OK; }
+        bfa_destroy(program);
+    }
+
+    bft_error rc = compile(program, code, size, level, evaluate);
+    if (rc == BFE_OK && path) {
+        // other processes see either old file or complete new one
+        size_t temp_size = strlen(path) + 32;
+        char* temp = malloc(temp_size);
+        if (temp) {
+            snprintf(temp, temp_size, "%s.%ld.tmp", path, (long)getpid());
+            if (bfa_save(program, hash, temp) == BFE_OK && rename(temp, path) != 0)
+                remove(temp);
+            free(temp);
+        }
+    }
+    free(path);
+    return rc;
+}
+
+static int compare_names(const void* lhs, const void* rhs) {
+    return strcmp(*(char* const*)lhs, *(char* const*)rhs);
+}
+
+static void free_inputs(bf_inputs* inputs) {
+    for (size_t i = 0; i < inputs->count; i++)
+        free(inputs->names[i]);
+    free(inputs->names);
+    free(inputs->results);
+}
+
+/* Regular files of directory except previous outputs */
+static bool list_inputs(const char* dir, bf_inputs* inputs) {
+    *inputs = (bf_inputs){ dir, NULL, NULL, 0 };
+#ifdef _WIN32
+    return false;
+#else
+    DIR* handle = opendir(dir);
+    if (!handle) return false;
+
+    size_t capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(handle))) {
+        const char* ext = strrchr(entry->d_name, '.');
+        if (ext && strcmp(ext, ".out") == 0) continue;
+
+        struct stat info;
+        char* path = join_path(dir, entry->d_name, "");
+        bool regular = path && stat(path, &info) == 0 && S_ISREG(info.st_mode);
+        free(path);
+        if (!regular) continue;
+
+        if (inputs->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** names = realloc(inputs->names, capacity * sizeof *names);
+            if (!names) break;
+            inputs->names = names;
+        }
+        inputs->names[inputs->count] = malloc(strlen(entry->d_name) + 1);
+        if (!inputs->names[inputs->count]) break;
+        strcpy(inputs->names[inputs->count++], entry->d_name);
+    }
+    closedir(handle);
+
+    if (entry) { free_inputs(inputs); return false; }
+    qsort(inputs->names, inputs->count, sizeof *inputs->names, compare_names);
+    inputs->results = calloc(inputs->count + 1, sizeof *inputs->results);
+    if (!inputs->results) { free_inputs(inputs); return false; }
+    return true;
+#endif
 }
 
 static void bf_read(void* file, bft_cell* cell) {
@@ -52,6 +253,39 @@ static void bf_write(void* file, bft_cell cell) {
     fputc(cell, file);
 }
 
+static size_t bf_read_block(void* file, bft_cell* cells, size_t count) {
+    return fread(cells, sizeof *cells, count, file);
+}
+
+static void bf_write_block(void* file, const bft_cell* cells, size_t count) {
+    fwrite(cells, sizeof *cells, count, file);
+}
+
+static bft_error batch_begin(void* data, size_t job, bft_env* env) {
+    bf_inputs* inputs = data;
+    char* input_path  = join_path(inputs->dir, inputs->names[job], "");
+    char* output_path = join_path(inputs->dir, inputs->names[job], ".out");
+    FILE* input  = input_path  ? fopen(input_path,  "rb") : NULL;
+    FILE* output = output_path ? fopen(output_path, "wb") : NULL;
+    free(input_path);
+    free(output_path);
+
+    *env = (bft_env){
+        input, output,
+        bf_read, bf_write,
+        bf_read_block, bf_write_block
+    };
+    return input && output ? BFE_OK : BFE_INVALID_ENV;
+}
+
+static void batch_end(void* data, size_t job, bft_env* env, bft_error rc) {
+    bf_inputs* inputs = data;
+    if (env->input)  fclose(env->input);
+    if (env->output) fclose(env->output);
+    if (rc) fprintf(stderr, ERROR_PREFIX "%s: %s\n", inputs->names[job], bfa_strerror(rc));
+    inputs->results[job] = rc;
+}
+
 int main(int argc, char** argv) {
     const char* exename = *argv++; --argc;
     const char* last_delim = strrchr(exename, PATH_DELIM);
@@ -64,8 +298,11 @@ int main(int argc, char** argv) {
     }
 
     const char* path = *argv++; --argc;
-    char* code_text = read_file(path);
-    if (!code_text) {
+    bool from_stdin = strcmp(path, "-") == 0;
+    char* code_text = from_stdin ? NULL : read_file(path);
+    if (from_stdin) {
+        path = "stdin";
+    } else if (!code_text) {
         fprintf(stderr, ERROR_PREFIX "cannot load file content\n");
         return EXIT_FAILURE;
     } else if (code_text[0] == '\0') {
@@ -74,17 +311,42 @@ int main(int argc, char** argv) {
         return EXIT_SUCCESS;
     }
 
-    bool output_asm = false;
+    bool output_asm = false, output_c = false, use_jit = false, use_cache = true;
+    bool profile = false, evaluate = false, wide = false;
+    int stats_format = 0; // 1 - text, 2 - JSON
+    int level = BFD_OPT_LEVEL;
+    size_t tape_size = 0, threads = 0;
+    const char* batch_dir = NULL;
 
-    if (argc >= 1) {
-        if (strcmp(*argv, "-A") == 0) {
-            output_asm = true;
+    while (argc >= 1 && (*argv)[0] == '-') {
+        /**/ if (strcmp(*argv, "-A") == 0) output_asm = true;
+        else if (strcmp(*argv, "-C") == 0) output_c = true;
+        else if (strcmp(*argv, "-J") == 0) use_jit = true;
+        else if (strcmp(*argv, "-P") == 0) profile = true;
+        else if (strcmp(*argv, "-E") == 0) evaluate = true;
+        else if (strcmp(*argv, "-W") == 0) wide = true;
+        else if (strncmp(*argv, "-O", 2) == 0 && (*argv)[2] >= '0' && (*argv)[2] <= '3'
+                && (*argv)[3] == '\0') level = (*argv)[2] - '0';
+        else if (strcmp(*argv, "--no-cache") == 0) use_cache = false;
+        else if (strcmp(*argv, "--stats") == 0) stats_format = 1;
+        else if (strcmp(*argv, "--stats=json") == 0) stats_format = 2;
+        else if (strcmp(*argv, "-M") == 0 && argc >= 2 && parse_size(argv[1], &tape_size)) {
             ++argv; --argc;
+        } else if (strcmp(*argv, "-j") == 0 && argc >= 2 && parse_size(argv[1], &threads)) {
+            ++argv; --argc;
+        } else if (strcmp(*argv, "--batch") == 0 && argc >= 2) {
+            batch_dir = *++argv; --argc;
+        } else {
+            fprintf(stderr, ERROR_PREFIX "unknown option '%s'\n", *argv);
+            usage(exename);
+            free(code_text);
+            return EXIT_FAILURE;
         }
+        ++argv; --argc;
     }
 
     FILE* input = stdin;
-    if (argc >= 1) {
+    if (argc >= 1 && !batch_dir) {
         const char* input_path = *argv++; --argc;
         input = fopen(input_path, "r");
         if (!input) {
@@ -96,24 +358,24 @@ int main(int argc, char** argv) {
 
     bft_error rc = BFE_OK;
     bft_program program = {0};
+    bft_wide_program wide_program = {0};
+    bft_context context = {0};
+    bft_jit jit = {0};
+    bft_stats stats = {0};
+    uint64_t* counts = NULL;
     bft_env env = {
         input, stdout,
-        bf_read, bf_write
+        bf_read, bf_write,
+        bf_read_block, bf_write_block
     };
 
-    rc = bfa_compile(&program, code_text, strlen(code_text));
+    rc = from_stdin
+        ? compile_stream(&program, stdin, level, evaluate)
+        : load_program(&program, code_text, use_cache, level, evaluate);
     if (rc) goto cleanup;
 
     if (output_asm) {
-        static char bfasm_path[272] = {0};
-        strcpy(bfasm_path, path);
-        char* ext_dot = strrchr(bfasm_path, '.');
-        if (ext_dot && strcmp(ext_dot, ".bf") == 0)
-            strcat(bfasm_path, "a");
-        else
-            strcat(bfasm_path, ".bfa");
-
-        FILE* asmf = fopen(bfasm_path, "w");
+        FILE* asmf = fopen(with_extension(path, ".bfa"), "w");
         if (asmf) {
             bfd_instrs_dump_txt(&program, asmf, -1);
             fclose(asmf);
@@ -121,19 +383,103 @@ int main(int argc, char** argv) {
             fprintf(stderr, ERROR_PREFIX "cannot open assembler file\n");
     }
 
-    bft_context context = {0};
+    if (output_c) {
+        FILE* srcf = fopen(with_extension(path, ".c"), "w");
+        if (srcf) {
+            rc = bfa_emit_c(&program, srcf);
+            fclose(srcf);
+            if (rc) goto cleanup;
+        } else
+            fprintf(stderr, ERROR_PREFIX "cannot open C source file\n");
+    }
+
+    if (profile && batch_dir) {
+        fprintf(stderr, WARN_PREFIX "profile is not written in batch mode\n");
+        profile = false;
+    }
+    if (profile) {
+        counts = calloc(program.count, sizeof *counts);
+        if (!counts) { rc = BFE_NO_MEMORY; goto cleanup; }
+        use_jit = false;
+    }
+
+    if (stats_format && (use_jit || profile || wide || batch_dir)) {
+        fprintf(stderr, WARN_PREFIX "statistics are collected only by interpreter\n");
+        stats_format = 0;
+    }
+    if (wide && (use_jit || profile || batch_dir)) {
+        fprintf(stderr, WARN_PREFIX "wide instructions are run only by interpreter\n");
+        wide = false;
+    }
+    if (wide) {
+        rc = bfa_widen(&program, level, &wide_program);
+        if (rc) goto cleanup;
+    }
+
+    if (use_jit) {
+        rc = bfa_jit_compile(&jit, &program);
+        if (rc) goto cleanup;
+    }
+
+    if (batch_dir) {
+        bf_inputs inputs;
+        if (!list_inputs(batch_dir, &inputs)) {
+            fprintf(stderr, ERROR_PREFIX "cannot read batch directory\n");
+            rc = BFE_INVALID_ENV;
+            goto cleanup;
+        }
+        bft_batch batch = {
+            &program, use_jit ? &jit : NULL,
+            inputs.count, threads, tape_size,
+            &inputs, batch_begin, batch_end
+        };
+        rc = bfa_batch_execute(&batch);
+        for (size_t i = 0; i < inputs.count && !rc; i++)
+            rc = inputs.results[i];
+        free_inputs(&inputs);
+        goto cleanup;
+    }
+
+    if (tape_size) {
+        rc = bfa_tape_create(&context, tape_size);
+        if (rc) goto cleanup;
+    }
+
     do {
-        rc = bfa_execute(&program, &env, &context);
+        rc = use_jit ? bfa_jit_execute(&jit, &env, &context)
+            : counts ? bfa_profile(&program, &env, &context, counts)
+            : wide ? bfa_execute_wide(&wide_program, &env, &context)
+            : stats_format ? bfa_stats(&program, &env, &context, &stats)
+            : bfa_execute(&program, &env, &context);
         if (rc == BFE_BREAKPOINT) {
             fprintf(stderr, "\n" INFO_PREFIX "dump local memory (pointer on %zu):\n", context.mc);
             bfd_memory_dump_loc(&context, stderr);
         }
     } while (rc == BFE_BREAKPOINT);
 
+    if (counts) {
+        FILE* proff = fopen(with_extension(path, ".bfa"), "w");
+        if (proff) {
+            bfd_profile_dump_txt(&program, counts, proff);
+            fclose(proff);
+        } else
+            fprintf(stderr, ERROR_PREFIX "cannot open profile file\n");
+    }
+
+    if (stats_format) {
+        fprintf(stderr, "\n");
+        if (stats_format == 2) bfd_stats_dump_json(&stats, stderr);
+        else bfd_stats_dump_txt(&stats, stderr);
+    }
+
 cleanup:
     if (input && input != stdin) fclose(input);
     if (rc) fprintf(stderr, "\n" ERROR_PREFIX "%s\n", bfa_strerror(rc));
+    if (context.flags & BFF_TAPE_EXTERNAL) bfa_tape_destroy(&context);
+    bfa_jit_destroy(&jit);
+    bfa_wide_destroy(&wide_program);
     bfa_destroy(&program);
+    free(counts);
     free(code_text);
     return rc;
 }
\ No newline at end of file
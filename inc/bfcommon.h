@@ -2,14 +2,18 @@
 #define BRAINFUCK_COMMON_H
 
 #include "bfconf.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 #define BFD_NBIT_MAX(bitcount) ((1 << (bitcount)) - 1)
 
-static struct bft_int14 { int16_t x : 14; } s14bit;
+struct bft_int14 { int16_t x : 14; };
 #define BFD_INT14_MIN (-8192)
 #define BFD_INT14_MAX   8191
-#define bfu_sign_extend_14(integer) \
-    (int64_t)(s14bit.x = (integer) & BFM_14BIT)
+
+struct bft_int24 { int32_t x : 24; };
+#define BFD_INT24_MIN (-8388608)
+#define BFD_INT24_MAX   8388607
 
 #define bfu_throw(rc_) do { rc = rc_; goto cleanup; } while (0)
 #define bfu_abs(x) ((x) < 0 ? -(x) : (x))
@@ -20,8 +24,20 @@ enum {
     BFM_12BIT = BFD_NBIT_MAX(12),
     BFM_JMP_ZBIT = 0x2000,
     BFM_EX_ARG = 0x3FF,
+    BFM_TAB_ID = 0xFF00,
+    BFM_TAB_ARG = 0xFF,
 };
 
+static inline int64_t bfu_sign_extend_14(int integer) {
+    struct bft_int14 value = { integer & BFM_14BIT };
+    return value.x;
+}
+
+static inline int32_t bfu_sign_extend_24(uint32_t integer) {
+    struct bft_int24 value = { integer & BFD_NBIT_MAX(24) };
+    return value.x;
+}
+
 enum {
     BFM_KIND_2BIT = 0xC000,
     BFM_KIND_3BIT = 0xE000,
@@ -34,6 +50,7 @@ enum {
     BFC_MAX_JUMP_SH_DIST = BFD_NBIT_MAX(12),
     BFC_MAX_JUMP_LO_DIST = BFD_NBIT_MAX(28),
     BFC_EX_ARG_MAX = BFD_NBIT_MAX(10),
+    BFC_TAB_ARG_MAX = BFD_NBIT_MAX(8),
 };
 
 /* Structure of virtual machine instructions
@@ -64,8 +81,30 @@ enum {
  *    -+-+-+-+-+-+-+-+-+-+-+-+-+-+-|
  *     |1|E-I|D|        arg        | - instruction within value
  *    -+-+-+-+-+-+-+-+-+-+-+-+-+-+-'
+ *      -+-+-+-+-+-+-+-+-+-+-+-+-+-.
+ *       |0|       ID (12 bit)     | - simple instruction
+ *      -+-+-+-+-+-+-+-+-+-+-+-+-+-|
+ *       |1| T-ID  |      arg      | - instruction with operand table
+ *      -+-+-+-+-+-+-+-+-+-+-+-+-+-'
  *
- * Note: halt instruction has value 0xDEAD
+ * Operand table of cyclic multi-add: arg pairs of words,
+ * signed 16-bit offset and coefficient in low 8 bits.
+ * Operand table of instructions at offset: one word
+ * with signed 16-bit offset from current cell.
+ * Strided scans have no operand table, arg is stride.
+ *
+ * Superinstructions replace pairs of instructions:
+ * set, change-move and move-change keep second word as
+ * operand (signed 16-bit value or offset), arg of last two
+ * is delta. Move-jump has signed 8-bit offset in arg and
+ * is followed by jump back which it performs.
+ *
+ * Store and output data have arg cells in next words, one
+ * cell per word; store has signed 16-bit offset of first
+ * cell before them. Both of them are made by evaluation
+ * of program start (bfa_evaluate).
+ *
+ * Note: halt instruction has value 0xDEAD (T-ID 0xE is reserved)
  */
 
 enum {
@@ -87,6 +126,19 @@ enum {
             BFI_MOV_LT_UNTIL_ZERO,
             BFI_MEMSET_ZERO,
             BFI_BREAKPOINT,
+        BFK_EXT_IM_TAB = BFK_EXT_IM | 1 << 12,
+            BFI_CYCLIC_MULTI = BFK_EXT_IM_TAB | 0 << 8,
+            BFI_CHG_AT       = BFK_EXT_IM_TAB | 1 << 8, // arg - delta
+            BFI_OUTNTIMES_AT = BFK_EXT_IM_TAB | 2 << 8, // arg - count - 1
+            BFI_IO_INPUT_AT  = BFK_EXT_IM_TAB | 3 << 8,
+            BFI_SCAN_RT      = BFK_EXT_IM_TAB | 4 << 8, // arg - stride
+            BFI_SCAN_LT      = BFK_EXT_IM_TAB | 5 << 8, // arg - stride
+            BFI_SET          = BFK_EXT_IM_TAB | 6 << 8,
+            BFI_CHG_MOV      = BFK_EXT_IM_TAB | 7 << 8, // arg - delta
+            BFI_MOV_CHG      = BFK_EXT_IM_TAB | 8 << 8, // arg - delta
+            BFI_MOV_JNZ      = BFK_EXT_IM_TAB | 9 << 8, // arg - offset
+            BFI_STORE        = BFK_EXT_IM_TAB | 10 << 8, // arg - count
+            BFI_OUTPUT_DATA  = BFK_EXT_IM_TAB | 11 << 8, // arg - count
         BFK_EXT_EX = BFK_EXT | 1 << 13,
             BFK_EXT_EX_IS_LEFT = 1 << 10,
             BFI_OUTNTIMES     = BFK_EXT_EX | 0 << 11,
@@ -95,4 +147,162 @@ enum {
             BFI_CYCLIC_MOVADD = BFK_EXT_EX | 3 << 11,
 };
 
+static inline bool bfu_is_table_instr(bft_instr instr) {
+    return instr != BFI_DEAD && (instr & (BFM_KIND_3BIT | 1 << 12)) == BFK_EXT_IM_TAB;
+}
+
+/* Count of words occupied by instruction */
+static inline size_t bfu_instr_size(bft_instr instr) {
+    if ((instr & BFM_KIND_2BIT) == BFK_JMP)
+        return instr & BFK_JMP_IS_LONG ? 2 : 1;
+    if (bfu_is_table_instr(instr)) switch (instr & BFM_TAB_ID) {
+        case BFI_CYCLIC_MULTI: return 1 + 2 * (instr & BFM_TAB_ARG);
+        case BFI_CHG_AT: case BFI_OUTNTIMES_AT: case BFI_IO_INPUT_AT:
+        case BFI_SET: case BFI_CHG_MOV: case BFI_MOV_CHG: return 2;
+        case BFI_STORE: return 2 + (instr & BFM_TAB_ARG);
+        case BFI_OUTPUT_DATA: return 1 + (instr & BFM_TAB_ARG);
+    }
+    return 1;
+}
+
+/* Structure of wide instructions
+ * .-+-+- ... -+-+-+-+-+-+-+-+-+-.
+ * |        operand        | kind| - 24-bit operand, kind is BFO_*
+ * '-+-+- ... -+-+-+-+-+-+-+-+-+-'
+ *
+ * Operand is signed delta, offset, count or stride as arg
+ * of decoded operation, jumps have absolute address of
+ * target in it (unsigned). Cyclic move-add keeps signed
+ * 16-bit offset above 8-bit coefficient, move-jump has
+ * offset and is followed by jump back.
+ *
+ * Instructions take as many words as narrow ones, so
+ * decoded form is the same: instructions at offset,
+ * change-move and move-change have signed 32-bit offset
+ * in second word (second word of set is unused), cyclic
+ * multi-add has pairs of offset and coefficient words,
+ * store has offset word and both store and output data
+ * have one cell per word.
+ */
+
+enum {
+    BFM_WIDE_KIND = BFD_NBIT_MAX(8),
+    BFC_WIDE_SHIFT = 8,
+    BFC_MAX_WIDE_ADDR = BFD_NBIT_MAX(24),
+};
+
+static inline bft_winstr bfu_wide(int kind, int32_t operand) {
+    return (bft_winstr)operand << BFC_WIDE_SHIFT | (bft_winstr)kind;
+}
+
+#if defined(__GNUC__) && !defined(BFD_SWITCH_DISPATCH)
+#define BFD_THREADED_DISPATCH 1
+#else
+#define BFD_THREADED_DISPATCH 0
+#endif
+
+/* Decoded form of program
+ * One operation per instruction word, so address of
+ * operation is equal to address of instruction.
+ * Operands are unpacked, jumps store absolute address.
+ * Tail words of multiword instructions decode as BFO_NOP.
+ */
+
+enum {
+    BFO_HALT,
+    BFO_CHG,           /* arg - delta */
+    BFO_CHG_AT,        /* arg - delta, off - offset */
+    BFO_MOV,           /* arg - offset */
+    BFO_JEZ,           /* arg - address */
+    BFO_JNZ,           /* arg - address */
+    BFO_INPUT,
+    BFO_INPUT_AT,      /* off - offset */
+    BFO_OUTPUT,        /* arg - count */
+    BFO_OUTPUT_AT,     /* arg - count, off - offset */
+    BFO_MEMSET_ZERO,
+    BFO_SCAN,          /* arg - signed stride */
+    BFO_CYCLIC_MOVADD, /* arg - coefficient, off - offset */
+    BFO_CYCLIC_MULTI,  /* arg - count of next operations with
+                          coefficient and offset, as above */
+    BFO_SET,           /* arg - value */
+    BFO_CHG_MOV,       /* arg - delta, off - offset */
+    BFO_MOV_CHG,       /* arg - delta, off - offset */
+    BFO_MOV_JNZ,       /* arg - address, off - offset */
+    BFO_STORE,         /* arg - count, off - offset, cells
+                          are args of operations after next */
+    BFO_OUTPUT_DATA,   /* arg - count, cells are args of next
+                          operations */
+    BFO_BREAKPOINT,
+    BFO_UNKNOWN,
+    BFO_NOP,
+    BFO_COUNT
+};
+
+typedef struct bft_op {
+    union {
+        const void* label;
+        int kind;
+    } op;
+    int32_t arg, off;
+} bft_op;
+
+bft_op* bfu_decode(const bft_program* program);
+bft_op* bfu_decode_wide(const bft_wide_program* program);
+
+/* Words of parser are lifted to list of operations,
+ * optimized by passes of level and lowered to result */
+bft_error bfu_optimize(const bft_program* program, int level, bft_program* result);
+
+/* Index of first zero cell visited by moving with stride
+ * from mc, or (size_t)-1 if it is outside of memory */
+size_t bfu_scan(const bft_cell* mem, size_t size, size_t mc, int32_t stride);
+
+/* Output is collected in buffer when environment has write_block
+ * function and is flushed when buffer is full, before input and
+ * on exit from machine. Otherwise each cell passed to write. */
+
+typedef struct bft_obuffer {
+    bft_env* env;
+    size_t   count;
+    bft_cell items[BFD_OUTPUT_BUFFER];
+} bft_obuffer;
+
+/* Memory of context is external one with its size or
+ * new default-sized memory, which released on exit. */
+
+static inline size_t bfu_context_size(const bft_context* ctx) {
+    return ctx->size ? ctx->size : BFC_MAX_MEMORY;
+}
+
+/* Machine stopped with context saved for resumption */
+static inline bool bfu_suspended(bft_error rc) {
+    return rc == BFE_BREAKPOINT || rc == BFE_YIELD || rc == BFE_NEED_INPUT;
+}
+
+bft_error bfu_tape_acquire(bft_context* ctx, const bft_context* ext_ctx);
+void      bfu_tape_release(bft_context* ctx);
+
+/* Run function, memory faults in guard regions of
+ * context's tape are returned as memory corruption */
+bft_error bfu_guarded(const bft_context* ctx, bft_error (*func)(void*), void* data);
+
+/* Release mapping of program loaded by bfa_load */
+void bfu_unmap_program(bft_program* prog);
+
+/* Environment passed to machine by bfa_stats, it counts
+ * cells and time of calls to environment of caller */
+typedef struct bft_stats_env {
+    bft_env env;
+    bft_env* inner;
+    bft_stats* stats;
+} bft_stats_env;
+
+void   bfu_stats_env(bft_stats_env* wrapper, bft_env* env, bft_stats* stats);
+double bfu_now(void); /* seconds of monotonic clock */
+
+bool bfu_valid_env(const bft_env* env);
+void bfu_output(bft_obuffer* buffer, bft_cell cell, size_t count);
+bool bfu_input (bft_obuffer* buffer, bft_cell* cell); /* false if would block */
+void bfu_flush (bft_obuffer* buffer);
+
 #endif // BRAINFUCK_COMMON_H
\ No newline at end of file
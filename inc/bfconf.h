@@ -5,29 +5,79 @@
 
 #define BFD_MEMORY_CAPACITY 32768
 #define BFD_BREAKPOINT_CHAR '#'
+#define BFD_OUTPUT_BUFFER 4096
+#define BFD_TAPE_GUARD 65536
+#define BFD_WOULD_BLOCK ((size_t)-1) /* read_block has no input yet */
+#define BFD_OPT_LEVEL 2 /* default level of optimizations, 0 - 3 */
 
 typedef uint8_t bft_cell;
 typedef uint16_t bft_instr;
+typedef uint32_t bft_winstr;
 
 typedef void (*bft_ifunc)(void*, bft_cell*);
 typedef void (*bft_ofunc)(void*, bft_cell );
+typedef size_t (*bft_ibfunc)(void*,       bft_cell*, size_t);
+typedef void   (*bft_obfunc)(void*, const bft_cell*, size_t);
 
 typedef struct bft_program {
     bft_instr* items;
     size_t     count;
+    void*  map;      /* mapped file of bfa_load, NULL if items are allocated */
+    size_t map_size;
 } bft_program;
 
+/* Program of wide instructions, made by bfa_widen */
+typedef struct bft_wide_program {
+    bft_winstr* items;
+    size_t      count;
+} bft_wide_program;
+
+/* Compilation of source passed in chunks,
+ * state is internal to bfa_compile_* functions */
+typedef struct bft_compiler {
+    void* state;
+    int level; /* of optimizations, set by begin, read by end */
+} bft_compiler;
+
 typedef struct bft_env {
     void *input, *output;
     bft_ifunc  read;
     bft_ofunc write;
+    bft_ibfunc  read_block; /* optional, returns count of read cells
+                               or BFD_WOULD_BLOCK */
+    bft_obfunc write_block; /* optional, gets buffered output */
 } bft_env;
 
+enum {
+    BFF_TAPE_EXTERNAL = 1 << 0, /* memory is not freed by machine */
+    BFF_TAPE_GUARDED  = 1 << 1, /* memory is surrounded by guard pages */
+};
+
 typedef struct bft_context {
     size_t pc, mc;
     bft_cell* mem;
+    size_t size; /* count of cells, 0 - BFD_MEMORY_CAPACITY */
+    int   flags;
 } bft_context;
 
+/* Counters of bfa_stats, added up over runs */
+typedef struct bft_stats {
+    uint64_t changes, moves, loops, sets, scans;  /* instructions run by class */
+    uint64_t cyclics, fused, inputs, outputs, others;
+    uint64_t scan_cells, scan_max; /* cells passed by scans, longest scan */
+    uint64_t bytes_in, bytes_out;
+    double read_time, write_time;  /* seconds spent in environment */
+    double total_time;             /* seconds of whole execution */
+    size_t peak;                   /* highest index of pointer */
+} bft_stats;
+
+typedef struct bft_jit {
+    bft_program* program;
+    void*   code;
+    size_t  size;
+    size_t* entries;
+} bft_jit;
+
 typedef enum bft_error {
     BFE_OK = 0,
     BFE_BREAKPOINT,
@@ -40,6 +90,25 @@ typedef enum bft_error {
     BFE_INVALID_ENV,
     BFE_UNKNOWN_INSTR,
     BFE_MEMORY_CORRUPTION,
+    BFE_FILE_ERROR,
+    BFE_INVALID_FORMAT,
+    BFE_YIELD,
+    BFE_NEED_INPUT,
+    BFE_PROGRAM_MISMATCH,
 } bft_error;
 
+/* One program over many jobs: begin fills environment
+ * of job, end gets result of job and releases it.
+ * Breakpoints in program are passed without stop. */
+typedef struct bft_batch {
+    bft_program* program;
+    bft_jit* jit;     /* optional, runs native code if set */
+    size_t count;     /* count of jobs */
+    size_t threads;   /* 0 - count of processors */
+    size_t tape_size; /* 0 - default memory, else bfa_tape_create */
+    void* data;
+    bft_error (*begin)(void* data, size_t job, bft_env* env);
+    void      (*end)  (void* data, size_t job, bft_env* env, bft_error rc);
+} bft_batch;
+
 #endif // BRAINFUCK_CONF_H
\ No newline at end of file
@@ -11,11 +11,43 @@ extern "C" {
 const char* bfa_strerror(bft_error error);
 
 bft_error bfa_compile(bft_program* program, const char* code, size_t size);
+bft_error bfa_compile_begin(bft_compiler* compiler);
+bft_error bfa_compile_feed (bft_compiler* compiler, const char* code, size_t size);
+bft_error bfa_compile_end  (bft_compiler* compiler, bft_program* program);
 bft_error bfa_execute(bft_program* program, bft_env* env, bft_context* ctx);
+bft_error bfa_execute_steps(bft_program* program, bft_env* env, bft_context* ctx, uint64_t steps);
+bft_error bfa_profile(bft_program* program, bft_env* env, bft_context* ctx, uint64_t* counts);
+bft_error bfa_stats  (bft_program* program, bft_env* env, bft_context* ctx, bft_stats* stats);
 void      bfa_destroy(bft_program* program);
 
+bft_error bfa_evaluate(bft_program* program, uint64_t steps);
+
+bft_error bfa_widen(const bft_program* program, int level, bft_wide_program* wide);
+bft_error bfa_execute_wide(bft_wide_program* program, bft_env* env, bft_context* ctx);
+void      bfa_wide_destroy(bft_wide_program* program);
+
+uint64_t  bfa_hash(const char* code, size_t size);
+bft_error bfa_save(bft_program* program, uint64_t hash, const char* path);
+bft_error bfa_load(bft_program* program, uint64_t* hash, const char* path);
+bft_error bfa_checkpoint_save(bft_program* program, const bft_context* ctx, const char* path);
+bft_error bfa_checkpoint_load(bft_program* program, bft_context* ctx, const char* path);
+
+bft_error bfa_tape_create (bft_context* ctx, size_t size);
+void      bfa_tape_destroy(bft_context* ctx);
+
+bft_error bfa_batch_execute(bft_batch* batch);
+
+bft_error bfa_emit_c(bft_program* program, FILE* dest);
+
+bft_error bfa_jit_compile(bft_jit* jit, bft_program* program);
+bft_error bfa_jit_execute(bft_jit* jit, bft_env* env, bft_context* ctx);
+void      bfa_jit_destroy(bft_jit* jit);
+
 void bfd_instr_description(bft_instr opcode, bft_instr next, FILE* dest);
 void bfd_instrs_dump_txt(bft_program* program, FILE* dest, size_t limit);
+void bfd_profile_dump_txt(bft_program* program, const uint64_t* counts, FILE* dest);
+void bfd_stats_dump_txt (const bft_stats* stats, FILE* dest);
+void bfd_stats_dump_json(const bft_stats* stats, FILE* dest);
 void bfd_memory_dump_txt(bft_context* context, FILE* dest, size_t offset, size_t size);
 void bfd_memory_dump_bin(bft_context* context, FILE* dest, size_t offset, size_t size);
 void bfd_memory_dump_loc(bft_context* context, FILE* dest);
@@ -31,4 +63,84 @@ void bfd_memory_dump_loc(bft_context* context, FILE* dest);
  * When current char is '@' break execute
  * program and save context by passed pointer.
  * For rerun program need pass saved context.
+ */
+
+/* Levels of optimizations:
+ * bfa_compile_begin sets level of compiler to BFD_OPT_LEVEL,
+ * it may be changed before bfa_compile_end, which runs passes
+ * of that level over compiled code. Level 0 keeps code of
+ * parser, 1 combines neighbouring instructions and drops
+ * dead stores, 2 adds superinstructions, 3 replaces linear
+ * loops on cells of known value with changes of cells.
+ */
+
+/* Evaluation of program start:
+ * bfa_evaluate runs compiled program up to steps operations
+ * before its first input, breakpoint or halt, and replaces
+ * instructions outside of loops run by that time with store
+ * of resulting memory, data of output and move of pointer.
+ * Evaluated program expects fresh memory of at least
+ * BFD_MEMORY_CAPACITY cells.
+ */
+
+/* Wide instructions:
+ * bfa_widen runs passes of level over compiled program and
+ * lowers it to 32-bit instructions with full operands and
+ * absolute jump targets, so moves, outputs and jumps take
+ * one instruction and superinstructions are not limited by
+ * size of operands. bfa_execute_wide executes such program
+ * as bfa_execute, context of it is resumed by same function.
+ */
+
+/* Time slicing:
+ * bfa_execute_steps executes program as bfa_execute until
+ * about steps instructions are run, then saves context and
+ * returns BFE_YIELD. Passing that context again resumes
+ * execution. Budget is checked on backward jumps only, each
+ * of them costs instructions of loop body, so at least one
+ * iteration of loop is run and budget may be exceeded by
+ * length of straight code between jumps.
+ */
+
+/* Non-blocking input:
+ * when read_block of environment returns BFD_WOULD_BLOCK,
+ * machine stops with BFE_NEED_INPUT and saves context with
+ * pc on input instruction. Passing that context again, once
+ * input is ready, repeats the input and resumes execution.
+ */
+
+/* Checkpoints:
+ * bfa_checkpoint_save writes context saved by suspended
+ * machine (pc, pointer, nonzero pages of memory) with hash
+ * of program to file. bfa_checkpoint_load fills new context
+ * from such file for same program, memory of tape created
+ * by bfa_tape_create is restored the same way. Position of
+ * input is not saved and is kept by environment.
+ */
+
+/* Profiling:
+ * bfa_profile executes program as bfa_execute and adds
+ * to counts[pc] number of runs of instruction at pc, so
+ * counts has program->count items and sums up over runs
+ * resumed after breakpoints. bfd_profile_dump_txt lists
+ * instructions with counts, runs of each kind of
+ * operation and hottest loops.
+ */
+
+/* Statistics:
+ * bfa_stats executes program as bfa_profile and adds to
+ * stats counts of instructions by class, cells passed by
+ * scans, cells read and written, time spent in functions
+ * of environment and in whole run, and keeps highest index
+ * of pointer. bfa_execute is not changed by it, so it
+ * costs nothing when not used. bfd_stats_dump_txt and
+ * bfd_stats_dump_json write stats for people and tools.
+ */
+
+/* Runtime-sized memory:
+ * bfa_tape_create reserves memory with at least size cells
+ * (rounded up to pages) between inaccessible guard regions.
+ * Machine skips bounds checks of moves on such memory and
+ * reports faults as memory corruption. Context stays owned
+ * by caller and is released with bfa_tape_destroy.
  */
\ No newline at end of file
@@ -0,0 +1,151 @@
+#define _DEFAULT_SOURCE
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BFD_BATCH_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#else
+#define BFD_BATCH_THREADS 0
+#endif
+
+static void bfb_run_job(bft_batch* batch, size_t job) {
+    bft_env env = {0};
+    bft_context ctx = {0};
+    bft_error rc = batch->begin(batch->data, job, &env);
+    if (rc == BFE_OK && batch->tape_size)
+        rc = bfa_tape_create(&ctx, batch->tape_size);
+    if (rc == BFE_OK) do {
+        rc = batch->jit
+            ? bfa_jit_execute(batch->jit, &env, &ctx)
+            : bfa_execute(batch->program, &env, &ctx);
+    } while (rc == BFE_BREAKPOINT);
+    if (batch->tape_size) bfa_tape_destroy(&ctx);
+    batch->end(batch->data, job, &env, rc);
+}
+
+#if BFD_BATCH_THREADS
+
+/*
+ * Every worker owns a range of job indices and takes
+ * jobs from its front. Worker with empty range steals
+ * back half of range from another worker, so long jobs
+ * do not leave rest of workers idle.
+ */
+
+typedef struct bft_worker {
+    pthread_mutex_t lock;
+    size_t begin, end;
+    pthread_t thread;
+    bool started;
+    struct bft_pool* pool;
+} bft_worker;
+
+typedef struct bft_pool {
+    bft_batch*  batch;
+    bft_worker* workers;
+    size_t count;
+} bft_pool;
+
+static bool bfb_take(bft_worker* worker, size_t* job) {
+    bool found = false;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->begin < worker->end) {
+        *job = worker->begin++;
+        found = true;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return found;
+}
+
+static bool bfb_steal(bft_worker* worker, size_t* job) {
+    bft_pool* pool = worker->pool;
+    size_t self = worker - pool->workers;
+
+    for (size_t i = 1; i < pool->count; i++) {
+        bft_worker* victim = pool->workers + (self + i) % pool->count;
+        size_t begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->begin;
+        if (left > 0) {
+            end = victim->end;
+            begin = end - (left + 1) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (begin == end) continue;
+
+        pthread_mutex_lock(&worker->lock);
+        worker->begin = begin + 1;
+        worker->end = end;
+        pthread_mutex_unlock(&worker->lock);
+        *job = begin;
+        return true;
+    }
+    return false;
+}
+
+static void* bfb_work(void* data) {
+    bft_worker* worker = data;
+    size_t job;
+    while (bfb_take(worker, &job) || bfb_steal(worker, &job))
+        bfb_run_job(worker->pool->batch, job);
+    return NULL;
+}
+
+bft_error bfa_batch_execute(bft_batch* batch) {
+    if (!batch || !batch->program || !batch->begin || !batch->end)
+        return BFE_NULL_POINTER;
+
+    size_t threads = batch->threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads > batch->count) threads = batch->count;
+    if (threads == 0) return BFE_OK;
+
+    bft_pool pool = { batch, calloc(threads, sizeof(bft_worker)), threads };
+    if (!pool.workers) return BFE_NO_MEMORY;
+
+    for (size_t i = 0; i < threads; i++) {
+        bft_worker* worker = pool.workers + i;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->begin = batch->count * i / threads;
+        worker->end = batch->count * (i + 1) / threads;
+        worker->pool = &pool;
+    }
+
+    // first worker runs on calling thread, jobs of
+    // workers which failed to start are stolen by others
+    for (size_t i = 1; i < threads; i++) {
+        bft_worker* worker = pool.workers + i;
+        worker->started = pthread_create(&worker->thread, NULL, bfb_work, worker) == 0;
+    }
+    bfb_work(pool.workers);
+
+    for (size_t i = 1; i < threads; i++)
+        if (pool.workers[i].started)
+            pthread_join(pool.workers[i].thread, NULL);
+
+    for (size_t i = 0; i < threads; i++)
+        pthread_mutex_destroy(&pool.workers[i].lock);
+    free(pool.workers);
+    return BFE_OK;
+}
+
+#else // not BFD_BATCH_THREADS
+
+bft_error bfa_batch_execute(bft_batch* batch) {
+    if (!batch || !batch->program || !batch->begin || !batch->end)
+        return BFE_NULL_POINTER;
+    for (size_t job = 0; job < batch->count; job++)
+        bfb_run_job(batch, job);
+    return BFE_OK;
+}
+
+#endif // BFD_BATCH_THREADS
@@ -5,29 +5,50 @@
 #include <string.h>
 
 #define INVAL_INDEX ((size_t)-1)
-#define PAREN_STACK_DEPTH 1023
 
-static struct bft_paren_stack {
-    size_t head, positions[PAREN_STACK_DEPTH];
-} paren_stack;
-
-static void bfs_init(struct bft_paren_stack* stack) { stack->head = 0; }
-
-static bft_error bfs_push(struct bft_paren_stack* stack, size_t pos) {
-    if (stack->head >= PAREN_STACK_DEPTH)
-        return BFE_STACK_OVERFLOW;
-    stack->positions[stack->head++] = pos;
+/* Position of opening jump and count of long jumps
+ * before it, so distance of loop accounts words which
+ * long jumps inside of loop get in fixup pass */
+struct bft_paren {
+    size_t pos, longs;
+};
+
+struct bft_paren_stack {
+    size_t head, capacity;
+    struct bft_paren* positions;
+};
+
+static bft_error bfs_push(struct bft_paren_stack* stack, struct bft_paren paren) {
+    if (stack->head == stack->capacity) {
+        size_t capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        struct bft_paren* positions = realloc(stack->positions, capacity * sizeof *positions);
+        if (!positions) return BFE_NO_MEMORY;
+        stack->positions = positions;
+        stack->capacity = capacity;
+    }
+    stack->positions[stack->head++] = paren;
     return BFE_OK;
 }
 
-static size_t bfs_pop(struct bft_paren_stack* stack) {
-    if (stack->head == 0) return INVAL_INDEX;
+static struct bft_paren bfs_pop(struct bft_paren_stack* stack) {
+    if (stack->head == 0) return (struct bft_paren){ INVAL_INDEX, 0 };
     return stack->positions[--stack->head];
 }
 
+/* Opening jump of long loop is kept as one word until
+ * end of compilation, its second word is inserted by
+ * bfc_fixup_longs in one pass over instructions */
+struct bft_long_jump {
+    size_t pos;
+    bft_instr low;
+};
+
 typedef struct {
     bft_instr* items;
     size_t count, capacity;
+    size_t last; // position of last instruction
+    struct bft_long_jump* longs;
+    size_t long_count, long_capacity;
 } bft_instrs;
 
 static bft_error bfc_reserve(bft_instrs* code) {
@@ -37,24 +58,56 @@ static bft_error bfc_reserve(bft_instrs* code) {
     return code->items ? BFE_OK : BFE_NO_MEMORY;
 }
 
-static bft_error bfc_push(bft_instrs* code, bft_instr instr) {
+static bft_error bfc_push_word(bft_instrs* code, bft_instr word) {
     if (bfc_reserve(code)) return BFE_NO_MEMORY;
-    code->items[code->count++] = instr;
+    code->items[code->count++] = word;
     return BFE_OK;
 }
 
-static bft_error bfc_insert(bft_instrs* code, bft_instr instr, size_t pos) {
-    if (bfc_reserve(code)) return BFE_NO_MEMORY;
-    memmove(code->items + pos + 1, code->items + pos,
-        (code->count - pos) * sizeof *code->items);
-    code->items[pos] = instr; ++code->count;
+static bft_error bfc_push(bft_instrs* code, bft_instr instr) {
+    code->last = code->count;
+    return bfc_push_word(code, instr);
+}
+
+static bft_error bfc_push_long(bft_instrs* code, size_t pos, bft_instr low) {
+    if (code->long_count == code->long_capacity) {
+        size_t capacity = code->long_capacity == 0 ? 16 : code->long_capacity * 2;
+        struct bft_long_jump* longs = realloc(code->longs, capacity * sizeof *longs);
+        if (!longs) return BFE_NO_MEMORY;
+        code->longs = longs;
+        code->long_capacity = capacity;
+    }
+    code->longs[code->long_count++] = (struct bft_long_jump){ pos, low };
     return BFE_OK;
 }
 
-static void bfc_erase(bft_instrs* code, size_t pos, size_t len) {
-    memmove(code->items + pos, code->items + pos + len,
-        (code->count - pos - len) * sizeof *code->items);
-    code->count -= len;
+static int bfc_compare_longs(const void* lhs, const void* rhs) {
+    size_t lpos = ((const struct bft_long_jump*)lhs)->pos;
+    size_t rpos = ((const struct bft_long_jump*)rhs)->pos;
+    return (lpos > rpos) - (lpos < rpos);
+}
+
+/* Every word moves once: segments between opening long
+ * jumps are shifted by count of long jumps before them */
+static bft_error bfc_fixup_longs(bft_instrs* code) {
+    size_t count = code->long_count;
+    if (count == 0) return BFE_OK;
+
+    bft_instr* items = realloc(code->items, (code->count + count) * sizeof *items);
+    if (!items) return BFE_NO_MEMORY;
+    code->items = items;
+    code->capacity = code->count + count;
+
+    qsort(code->longs, count, sizeof *code->longs, bfc_compare_longs);
+    size_t end = code->count;
+    for (size_t j = count; j-- > 0;) {
+        size_t pos = code->longs[j].pos;
+        memmove(items + pos + j + 2, items + pos + 1, (end - pos - 1) * sizeof *items);
+        items[pos + j + 1] = code->longs[j].low;
+        end = pos + 1;
+    }
+    code->count += count;
+    return BFE_OK;
 }
 
 #define bfi_last(src) src->items[src->count - 1]
@@ -64,55 +117,29 @@ static void bfc_erase(bft_instrs* code, size_t pos, size_t len) {
         bfu_throw(BFE_NO_MEMORY); \
 } while (0)
 
-#define bfi_insert(dest, instr, pos) do { \
-    if (bfc_insert(dest, instr, pos)) \
+#define bfi_push_word(dest, word) do { \
+    if (bfc_push_word(dest, word)) \
         bfu_throw(BFE_NO_MEMORY); \
 } while (0)
 
-static bool bfi_prev_is(bft_instrs* code, int type) {
-    return code->count && (bfi_last(code) & BFM_KIND_2BIT) == type;
-}
-
-static bool bfp_is_oper(char ch) {
-    return ch == ',' || ch == '.' || ch == '+' || ch == '-'
-        || ch == '>' || ch == '<' || ch == '[' || ch == ']'
-        || ch == BFD_BREAKPOINT_CHAR;
-}
+#define bfi_push_long(dest, pos, low) do { \
+    if (bfc_push_long(dest, pos, low)) \
+        bfu_throw(BFE_NO_MEMORY); \
+} while (0)
 
-static const char* bfp_next_oper(const char* ptr, const char* end) {
-    while (ptr < end && !bfp_is_oper(*ptr)) ++ptr;
-    return ptr;
+static bool bfi_prev_is(bft_instrs* code, int type) {
+    return code->count && code->last == code->count - 1
+        && (bfi_last(code) & BFM_KIND_2BIT) == type;
 }
 
-static const char* bfp_skip_n_opers(const char* ptr, const char* end, size_t count) {
-    while (ptr < end && count > 0)
-        if (bfp_is_oper(*ptr++)) --count;
-    return ptr;
-}
+static const bool bfp_opers[256] = {
+    [','] = true, ['.'] = true, ['+'] = true, ['-'] = true,
+    ['>'] = true, ['<'] = true, ['['] = true, [']'] = true,
+    [(unsigned char)BFD_BREAKPOINT_CHAR] = true,
+};
 
-static bool bfp_has_pattern(const char* ptr, const char* end, const char* pattern) {
-    ptr = bfp_next_oper(ptr, end);
-    while (ptr < end && *ptr == *pattern) {
-        ptr = bfp_next_oper(ptr + 1, end);
-        ++pattern;
-    }
-    return *pattern == '\0';
-}
-
-static const char* bfp_collapse_opers(
-    const char* ptr, const char* end,
-    struct bft_int14* acc, char inc, char dec
-) {
-    ptr = bfp_next_oper(ptr, end);
-    while (ptr < end) {
-        /*  */ if (*ptr == inc) {
-            if (acc->x < BFD_INT14_MAX) ++acc->x; else return ptr;
-        } else if (*ptr == dec) {
-            if (acc->x > BFD_INT14_MIN) --acc->x; else return ptr;
-        } else return ptr;
-        ptr = bfp_next_oper(ptr + 1, end);
-    }
-    return ptr;
+static bool bfp_is_oper(char ch) {
+    return bfp_opers[(unsigned char)ch];
 }
 
 static bft_error bfp_collapse_instr(bft_instrs* code, int type, struct bft_int14 cur_acc) {
@@ -143,148 +170,442 @@ cleanup:
 }
 
 /*
- * find patterns:
- * [-(>|<)*n+*n(<|>)*n]
- * [(>|<)*n+*n(<|>)*n-]
+ * Moves inside straight-line code are deferred: cell
+ * changes and input/output address cells by offset
+ * from pointer, single move is emitted before jumps.
  */
-static bool bfp_find_cycled_ops(bft_instrs* code, size_t jz_pos) {
-    bft_instr i1, i2, i3, i4;
-    i1 = code->items[jz_pos + 1];
-    i2 = code->items[jz_pos + 2];
-    i3 = code->items[jz_pos + 3];
-    i4 = code->items[jz_pos + 4];
-    int movn, addn;
-
-    /*  */ if ((i1 & BFM_KIND_3BIT) == BFK_DEC) { // minus 1
-        if (bfu_sign_extend_14(i1) != -1)         return false;
-        if ((i2 & BFM_KIND_2BIT) != BFI_MOV)      return false; // mov by x
-        movn = bfu_sign_extend_14(i2);
-        if ((i3 & BFM_KIND_3BIT) != BFK_INC)      return false; // plus n
-        addn = bfu_sign_extend_14(i3);
-        if ((i4 & BFM_KIND_2BIT) != BFI_MOV)      return false; // mov by -x
-        if (bfu_sign_extend_14(i4) != -movn)      return false;
-        /* here is all good */
-    } else if ((i1 & BFM_KIND_2BIT) == BFI_MOV) { // mov by x
-        movn = bfu_sign_extend_14(i1);
-        if ((i2 & BFM_KIND_3BIT) != BFK_INC)      return false; // plus n
-        addn = bfu_sign_extend_14(i2);
-        if ((i3 & BFM_KIND_2BIT) != BFI_MOV)      return false; // mov by -x
-        if (bfu_sign_extend_14(i3) != -movn)      return false;
-        if ((i4 & BFM_KIND_3BIT) != BFK_DEC)      return false; // minus 1
-        if (bfu_sign_extend_14(i4) != -1)         return false;
-        /* here is all good */
-    } else // no pattern starts
-        return false;
+static bft_error bfp_flush_move(bft_instrs* code, int32_t* pending) {
+    bft_error rc = BFE_OK;
+    while (*pending != 0 && !rc) {
+        struct bft_int14 acc = {
+            *pending > BFD_INT14_MAX ? BFD_INT14_MAX :
+            *pending < BFD_INT14_MIN ? BFD_INT14_MIN : *pending
+        };
+        *pending -= acc.x;
+        rc = bfp_collapse_instr(code, BFI_MOV, acc);
+    }
+    return rc;
+}
 
-    /**/ if (bfu_abs(movn) == 1 && addn <= BFC_EX_ARG_MAX)
-        code->items[jz_pos] = BFI_CYCLIC_ADD | (addn & BFM_EX_ARG);
-    else if (addn == 1 && bfu_abs(movn) <= BFC_EX_ARG_MAX)
-        code->items[jz_pos] = BFI_CYCLIC_MOV | (bfu_abs(movn) & BFM_EX_ARG);
-    else if (addn < 32 && bfu_abs(movn) < 32)
-        code->items[jz_pos] = BFI_CYCLIC_MOVADD | (bfu_abs(movn) & 0x1F) << 5 | (addn & 0x1F);
-    else
+static bft_error bfp_defer_move(bft_instrs* code, int32_t* pending, int32_t delta) {
+    int32_t next = *pending + delta;
+    if (next < INT16_MIN || next > INT16_MAX) {
+        bft_error rc = bfp_flush_move(code, pending);
+        if (rc) return rc;
+        next = delta;
+    }
+    *pending = next;
+    return BFE_OK;
+}
+
+static bft_error bfp_push_at(bft_instrs* code, bft_instr instr, int32_t offset) {
+    bft_error rc = BFE_OK;
+    bfi_push(code, instr);
+    bfi_push_word(code, offset & BFM_16BIT);
+cleanup:
+    return rc;
+}
+
+/*
+ * find loops which only move pointer and
+ * replace them with scan: [>>], [<<<], [>>>>]
+ */
+static bool bfp_find_scan_loop(bft_instrs* code, size_t jz_pos) {
+    if (code->count != jz_pos + 2 || !bfi_prev_is(code, BFI_MOV))
         return false;
 
-    if (movn < 0) code->items[jz_pos] |= BFK_EXT_EX_IS_LEFT;
-    code->count = jz_pos + 1;
+    int32_t stride = bfu_sign_extend_14(bfi_last(code));
+    if (bfu_abs(stride) > BFC_TAB_ARG_MAX) return false;
+
+    code->count = jz_pos;
+    /**/ if (stride ==  1) bfc_push(code, BFI_MOV_RT_UNTIL_ZERO);
+    else if (stride == -1) bfc_push(code, BFI_MOV_LT_UNTIL_ZERO);
+    else bfc_push(code, (stride > 0 ? BFI_SCAN_RT : BFI_SCAN_LT) | bfu_abs(stride));
     return true;
 }
 
-bft_error bfa_compile(bft_program* prog, const char* src, size_t size) {
-    if (!prog || (!src && size > 0))
-        return BFE_NULL_POINTER;
+/*
+ * find balanced loops without input/output
+ * which change loop cell by one and only add
+ * to other cells: [->+<], [->+>+++<<], [>-<+]
+ */
+static bft_error bfp_find_linear_loop(bft_instrs* code, size_t jz_pos, bool* found) {
+    struct { int32_t offset; bft_cell coef; } cells[BFC_TAB_ARG_MAX];
+    size_t count = 0, targets = 0;
+    int32_t offset = 0;
+    bft_cell delta = 0;
+    bft_error rc = BFE_OK;
+    *found = false;
+
+    for (size_t i = jz_pos + 1; i < code->count; i += bfu_instr_size(code->items[i])) {
+        bft_instr instr = code->items[i];
+        int32_t value = bfu_sign_extend_14(instr), at = offset;
+        /**/ if ((instr & BFM_KIND_2BIT) == BFI_MOV) { offset += value; continue; }
+        else if ((instr & BFM_TAB_ID) == BFI_CHG_AT) {
+            at += (int16_t)code->items[i + 1];
+            value = instr & BFM_TAB_ARG;
+        } else if ((instr & BFM_KIND_2BIT) != BFI_CHG) return rc;
+        if (at == 0) { delta += value; continue; }
+
+        size_t j = 0;
+        while (j < count && cells[j].offset != at) ++j;
+        if (j == count) {
+            if (count == BFC_TAB_ARG_MAX) return rc;
+            cells[count].offset = at;
+            cells[count++].coef = 0;
+        }
+        cells[j].coef += value;
+    }
+
+    if (offset != 0) return rc;
+    if (delta != 1 && delta != (bft_cell)-1) return rc;
+
+    for (size_t j = 0; j < count; j++) {
+        if (cells[j].coef == 0) continue;
+        if (cells[j].offset < INT16_MIN || cells[j].offset > INT16_MAX) return rc;
+        if (delta == 1) cells[j].coef = -cells[j].coef;
+        cells[targets++] = cells[j];
+    }
+
+    code->count = jz_pos;
+    *found = true;
+
+    if (targets == 1) {
+        int32_t movn = cells[0].offset, addn = cells[0].coef;
+        bft_instr instr = movn < 0 ? BFK_EXT_EX_IS_LEFT : 0;
+        /**/ if (bfu_abs(movn) == 1)
+            instr |= BFI_CYCLIC_ADD | (addn & BFM_EX_ARG);
+        else if (addn == 1 && bfu_abs(movn) <= BFC_EX_ARG_MAX)
+            instr |= BFI_CYCLIC_MOV | (bfu_abs(movn) & BFM_EX_ARG);
+        else if (addn < 32 && bfu_abs(movn) < 32)
+            instr |= BFI_CYCLIC_MOVADD | (bfu_abs(movn) & 0x1F) << 5 | (addn & 0x1F);
+        else
+            instr = 0;
+        if (instr) { bfi_push(code, instr); return rc; }
+    }
+
+    if (targets == 0) {
+        bfi_push(code, BFI_MEMSET_ZERO);
+        return rc;
+    }
+
+    bfi_push(code, BFI_CYCLIC_MULTI | targets);
+    for (size_t j = 0; j < targets; j++) {
+        bfi_push_word(code, cells[j].offset & BFM_16BIT);
+        bfi_push_word(code, cells[j].coef);
+    }
+
+cleanup:
+    return rc;
+}
+
+/*
+ * Values of cells are tracked along straight code relative
+ * to start of tracking: memory is zero before first
+ * instruction, loop cell is zero after its loop and after
+ * clear, changes of known cells keep them known. Loops on
+ * known zero cell never run and are skipped with clears
+ * among them. Entering loop, scan and breakpoint forget all
+ * values, input forgets its cell.
+ */
+enum { BFP_KNOWN_CELLS = 16 };
+
+struct bft_known_cell {
+    int64_t offset;
+    bft_cell value;
+};
+
+/*
+ * Source is consumed one operator at a time, so it may
+ * come in chunks of any size. Runs of operators which
+ * collapse to one instruction are accumulated in state,
+ * opening bracket waits for two next operators to check
+ * for [-], [+], [>] and [<].
+ */
+typedef struct bft_cstate {
+    bft_instrs code[1];
+    struct bft_paren_stack paren_stack[1];
+    int32_t pending;       // deferred move
+    char run;              // '+', '>', '.' or 0 if no run
+    struct bft_int14 acc;  // sum of '+' or '>' run
+    int dots, dot_limit;   // extra outputs of '.' run
+    bool open;             // '[' waits for lookahead
+    size_t looked;
+    char lookahead[1];
+    size_t skip;           // depth of skipped dead loop
+    int64_t pointer;       // offset of pointer with deferred move
+    struct bft_known_cell known[BFP_KNOWN_CELLS];
+    size_t known_count;
+    bool opaque;           // cells not in known may be nonzero
+    bft_error rc;          // first error of feed
+} bft_cstate;
+
+static struct bft_known_cell* bfp_known(bft_cstate* st) {
+    for (size_t i = 0; i < st->known_count; i++)
+        if (st->known[i].offset == st->pointer) return st->known + i;
+    return NULL;
+}
+
+static bool bfp_known_zero(bft_cstate* st) {
+    struct bft_known_cell* cell = bfp_known(st);
+    return cell ? cell->value == 0 : !st->opaque;
+}
+
+static void bfp_know(bft_cstate* st, bft_cell value) {
+    struct bft_known_cell* cell = bfp_known(st);
+    if (!cell && st->known_count == BFP_KNOWN_CELLS) {
+        st->known_count = 0; // dropped cells are unknown now
+        st->opaque = true;
+    }
+    if (!cell) cell = st->known + st->known_count++;
+    cell->offset = st->pointer;
+    cell->value = value;
+}
+
+static void bfp_forget(bft_cstate* st) {
+    struct bft_known_cell* cell = bfp_known(st);
+    if (cell) *cell = st->known[--st->known_count];
+    st->opaque = true;
+}
+
+static void bfp_forget_all(bft_cstate* st) {
+    st->known_count = 0;
+    st->opaque = true;
+}
+
+static void bfp_change_known(bft_cstate* st, bft_cell delta) {
+    struct bft_known_cell* cell = bfp_known(st);
+    /**/ if (cell) cell->value += delta;
+    else if (!st->opaque) bfp_know(st, delta);
+}
 
-    bfs_init(&paren_stack);
-    bft_instrs code[1] = {0};
+static bft_error bfp_end_run(bft_cstate* st) {
+    bft_instrs* code = st->code;
     bft_error rc = BFE_OK;
+    char run = st->run;
+    st->run = '\0';
+
+    if (run == '>') st->pointer += st->acc.x;
+    if (run == '+') bfp_change_known(st, st->acc.x);
+
+    /**/ if (run == '>')
+        rc = bfp_defer_move(code, &st->pending, st->acc.x);
+    else if (run == '+' && st->pending == 0)
+        rc = bfp_collapse_instr(code, BFI_CHG, st->acc);
+    else if (run == '+' && (bft_cell)st->acc.x != 0)
+        rc = bfp_push_at(code, BFI_CHG_AT | (st->acc.x & BFM_TAB_ARG), st->pending);
+    else if (run == '.' && st->pending == 0)
+        rc = bfc_push(code, BFI_OUTNTIMES | st->dots);
+    else if (run == '.')
+        rc = bfp_push_at(code, BFI_OUTNTIMES_AT | st->dots, st->pending);
+    return rc;
+}
 
-    const char* end = src + size;
-    char ch, inc = '\0', dec = '\0';
-
-    while (src < end) {
-        switch ((ch = *src++)) {
-            case BFD_BREAKPOINT_CHAR: bfi_push(code, BFI_BREAKPOINT); break;
-            case ',': bfi_push(code, BFI_IO_INPUT); break;
-            case '.': {
-                int count = 0;
-                src = bfp_next_oper(src, end);
-                while (src < end) {
-                    if (*src != '.' || count >= BFC_EX_ARG_MAX) break;
-                    ++count; src = bfp_next_oper(src + 1, end);
-                }
-                bfi_push(code, BFI_OUTNTIMES | count);
-            } break;
-            case '+': case '-': case '>': case '<': {
-                /**/ if (ch == '+' || ch == '-') inc = '+', dec = '-';
-                else if (ch == '>' || ch == '<') inc = '>', dec = '<';
-                struct bft_int14 acc = { ch == inc ? 1 : -1 };
-                src = bfp_collapse_opers(src, end, &acc, inc, dec);
-                rc  = bfp_collapse_instr(code, inc == '+' ? BFI_CHG : BFI_MOV, acc);
-                if (rc) goto cleanup;
-            } break;
-            case '[': {
-                /*  */ if (bfp_has_pattern(src, end, "-]")
-                        || bfp_has_pattern(src, end, "+]")) {
-                    bfi_push(code, BFI_MEMSET_ZERO);
-                    src = bfp_skip_n_opers(src, end, 2);
-                } else if (bfp_has_pattern(src, end, ">]")) {
-                    bfi_push(code, BFI_MOV_RT_UNTIL_ZERO);
-                    src = bfp_skip_n_opers(src, end, 2);
-                } else if (bfp_has_pattern(src, end, "<]")) {
-                    bfi_push(code, BFI_MOV_LT_UNTIL_ZERO);
-                    src = bfp_skip_n_opers(src, end, 2);
-                } else {
-                    if (bfs_push(&paren_stack, code->count))
-                        bfu_throw(BFE_STACK_OVERFLOW);
-                    bfi_push(code, BFI_JEZ); // placeholder
-                }
-            } break;
-            case ']': {
-                size_t pos = bfs_pop(&paren_stack);
-                if (pos == INVAL_INDEX)
-                    bfu_throw(BFE_UNBALANCED_BRACKETS);
-
-                size_t dist = code->count - pos;
-                /*  */ if (dist > BFC_MAX_JUMP_LO_DIST) {
-                    bfu_throw(BFE_VERY_LONG_JUMP);
-                } else if (dist > BFC_MAX_JUMP_SH_DIST) {
-                    code->items[pos] = BFI_JEZ | BFK_JMP_IS_LONG | (dist >> 16);
-                    bfi_insert(code,   dist & BFM_16BIT, pos + 1);
-                    bfi_push(code,     BFI_JNZ | BFK_JMP_IS_LONG | (dist >> 16));
-                    bfi_push(code,     dist & BFM_16BIT);
-                } else {
-                    /**/ if (dist == 5 && bfp_find_cycled_ops(code, pos)) break;
-                    else {
-                        code->items[pos] = BFI_JEZ | dist;
-                        bfi_push(code,     BFI_JNZ | dist);
-                    }
-                }
-            } break;
-        }
+/* Count of run grows until it reaches limit of instruction */
+static bft_error bfp_run(bft_cstate* st, char run, int delta) {
+    if (st->run == run) {
+        /**/ if (run == '.' && st->dots < st->dot_limit) { ++st->dots; return BFE_OK; }
+        else if (run != '.' && delta > 0 && st->acc.x < BFD_INT14_MAX) { ++st->acc.x; return BFE_OK; }
+        else if (run != '.' && delta < 0 && st->acc.x > BFD_INT14_MIN) { --st->acc.x; return BFE_OK; }
     }
+    bft_error rc = bfp_end_run(st);
+    if (rc) return rc;
 
-    if (paren_stack.head > 0)
+    st->run = run;
+    st->acc.x = delta;
+    st->dots = 0;
+    st->dot_limit = st->pending ? BFC_TAB_ARG_MAX : BFC_EX_ARG_MAX;
+    return BFE_OK;
+}
+
+static bft_error bfp_open(bft_cstate* st) {
+    bft_error rc = BFE_OK;
+    struct bft_paren paren = { st->code->count, st->code->long_count };
+    bfp_forget_all(st);
+    if (bfs_push(st->paren_stack, paren))
+        bfu_throw(BFE_NO_MEMORY);
+    bfi_push(st->code, BFI_JEZ); // placeholder
+cleanup:
+    return rc;
+}
+
+static bft_error bfp_close(bft_cstate* st) {
+    bft_instrs* code = st->code;
+    bft_error rc = BFE_OK;
+
+    struct bft_paren paren = bfs_pop(st->paren_stack);
+    size_t pos = paren.pos;
+    if (pos == INVAL_INDEX)
         bfu_throw(BFE_UNBALANCED_BRACKETS);
-    bfi_push(code, BFI_DEAD);
 
-    while ((code->items[0] & BFM_KIND_3BIT) == BFI_JEZ) {
-        bft_instr curr = code->items[0];
-        bft_instr next = code->items[1];
+    size_t dist = code->count - pos + code->long_count - paren.longs;
+    /*  */ if (dist > BFC_MAX_JUMP_LO_DIST) {
+        bfu_throw(BFE_VERY_LONG_JUMP);
+    } else if (dist > BFC_MAX_JUMP_SH_DIST) {
+        code->items[pos] = BFI_JEZ | BFK_JMP_IS_LONG | (dist >> 16);
+        bfi_push_long(code, pos, dist & BFM_16BIT);
+        bfi_push(code,     BFI_JNZ | BFK_JMP_IS_LONG | (dist >> 16));
+        bfi_push_word(code, dist & BFM_16BIT);
+    } else if (!bfp_find_scan_loop(code, pos)) {
+        bool found = false;
+        rc = bfp_find_linear_loop(code, pos, &found);
+        if (rc) goto cleanup;
+        if (!found) {
+            code->items[pos] = BFI_JEZ | dist;
+            bfi_push(code,     BFI_JNZ | dist);
+        }
+    }
+    bfp_forget_all(st);
+    bfp_know(st, 0);
+cleanup:
+    return rc;
+}
 
-        size_t size = curr & BFM_12BIT;
-        if (curr & BFK_JMP_IS_LONG)
-            size = (size << 16) + next;
-        size += curr & BFK_JMP_IS_LONG ? 3 : 1;
+static bft_error bfp_oper(bft_cstate* st, char ch);
 
-        bfc_erase(code, 0, size);
+/* Lookahead of '[' did not match, so loop is compiled as is */
+static bft_error bfp_open_as_is(bft_cstate* st) {
+    st->open = false;
+    bft_error rc = bfp_open(st);
+    for (size_t i = 0; i < st->looked && !rc; i++)
+        rc = bfp_oper(st, st->lookahead[i]);
+    return rc;
+}
+
+static bft_error bfp_oper(bft_cstate* st, char ch) {
+    bft_instrs* code = st->code;
+    bft_error rc = BFE_OK;
+
+    if (st->skip) {
+        /**/ if (ch == '[') ++st->skip;
+        else if (ch == ']') --st->skip;
+        return rc;
     }
 
-    prog->count = code->count;
-    prog->items = realloc(code->items,
-        code->count * sizeof *code->items);
+    if (st->open) {
+        bool looks = ch == '-' || ch == '+' || ch == '>' || ch == '<';
+        if (st->looked == 0 && looks) {
+            st->lookahead[st->looked++] = ch;
+            return rc;
+        }
+        if (st->looked == 1 && ch == ']') {
+            st->open = false;
+            char prev = st->lookahead[0];
+            /**/ if (prev == '-' || prev == '+') bfi_push(code, BFI_MEMSET_ZERO);
+            else if (prev == '>') bfi_push(code, BFI_MOV_RT_UNTIL_ZERO);
+            else bfi_push(code, BFI_MOV_LT_UNTIL_ZERO);
+            if (prev == '>' || prev == '<') bfp_forget_all(st);
+            bfp_know(st, 0);
+            return rc;
+        }
+        if ((rc = bfp_open_as_is(st))) goto cleanup;
+    }
+
+    switch (ch) {
+        case '+': case '-': return bfp_run(st, '+', ch == '+' ? 1 : -1);
+        case '>': case '<': return bfp_run(st, '>', ch == '>' ? 1 : -1);
+        case '.': return bfp_run(st, '.', 0);
+    }
 
-    return prog->items ? BFE_OK : BFE_NO_MEMORY;
+    if ((rc = bfp_end_run(st))) goto cleanup;
+    if (ch != ',' && (rc = bfp_flush_move(code, &st->pending))) goto cleanup;
+
+    switch (ch) {
+        case BFD_BREAKPOINT_CHAR:
+            bfp_forget_all(st);
+            bfi_push(code, BFI_BREAKPOINT);
+            break;
+        case ',':
+            bfp_forget(st);
+            if (st->pending == 0) bfi_push(code, BFI_IO_INPUT);
+            else rc = bfp_push_at(code, BFI_IO_INPUT_AT, st->pending);
+            break;
+        case '[':
+            /**/ if (bfp_known_zero(st)) st->skip = 1;
+            else { st->open = true; st->looked = 0; }
+            break;
+        case ']':
+            rc = bfp_close(st);
+            break;
+    }
 cleanup:
+    return rc;
+}
+
+bft_error bfa_compile_begin(bft_compiler* compiler) {
+    if (!compiler) return BFE_NULL_POINTER;
+    compiler->state = calloc(1, sizeof(bft_cstate));
+    compiler->level = BFD_OPT_LEVEL;
+    return compiler->state ? BFE_OK : BFE_NO_MEMORY;
+}
+
+bft_error bfa_compile_feed(bft_compiler* compiler, const char* src, size_t size) {
+    if (!compiler || !compiler->state || (!src && size > 0))
+        return BFE_NULL_POINTER;
+
+    bft_cstate* st = compiler->state;
+    for (const char* end = src + size; src < end && !st->rc; src++) {
+        char ch = *src;
+        if (!bfp_is_oper(ch)) continue;
+
+        // continue current run without going through bfp_oper
+        if (st->skip) {
+            /**/ if (ch == '[') ++st->skip;
+            else if (ch == ']') --st->skip;
+            continue;
+        } else if (!st->open) {
+            /**/ if (ch == '+' || ch == '>') {
+                if (st->run == (ch == '+' ? '+' : '>') && st->acc.x < BFD_INT14_MAX) {
+                    ++st->acc.x; continue;
+                }
+            } else if (ch == '-' || ch == '<') {
+                if (st->run == (ch == '-' ? '+' : '>') && st->acc.x > BFD_INT14_MIN) {
+                    --st->acc.x; continue;
+                }
+            } else if (ch == '.' && st->run == '.' && st->dots < st->dot_limit) {
+                ++st->dots; continue;
+            }
+        }
+        st->rc = bfp_oper(st, ch);
+    }
+    return st->rc;
+}
+
+bft_error bfa_compile_end(bft_compiler* compiler, bft_program* prog) {
+    if (!compiler || !compiler->state) return BFE_NULL_POINTER;
+
+    bft_cstate* st = compiler->state;
+    bft_instrs* code = st->code;
+    bft_error rc = prog ? st->rc : BFE_NULL_POINTER;
+    if (rc) goto cleanup;
+
+    if (st->open && (rc = bfp_open_as_is(st))) goto cleanup;
+    if ((rc = bfp_end_run(st))) goto cleanup;
+    if (st->skip || st->paren_stack->head > 0)
+        bfu_throw(BFE_UNBALANCED_BRACKETS);
+    if ((rc = bfp_flush_move(code, &st->pending))) goto cleanup;
+    bfi_push(code, BFI_DEAD);
+    if (bfc_fixup_longs(code))
+        bfu_throw(BFE_NO_MEMORY);
+
+    bft_program parsed = { code->items, code->count, NULL, 0 };
+    rc = bfu_optimize(&parsed, compiler->level, prog);
+cleanup:
+    free(st->paren_stack->positions);
+    free(code->longs);
     free(code->items);
+    free(st);
+    compiler->state = NULL;
     return rc;
-}
\ No newline at end of file
+}
+
+bft_error bfa_compile(bft_program* prog, const char* src, size_t size) {
+    if (!prog || (!src && size > 0))
+        return BFE_NULL_POINTER;
+
+    bft_compiler compiler;
+    bft_error rc = bfa_compile_begin(&compiler);
+    if (rc) return rc;
+    bfa_compile_feed(&compiler, src, size);
+    return bfa_compile_end(&compiler, prog);
+}
@@ -1,6 +1,7 @@
 #include "brainfuck.h"
 #include "bfcommon.h"
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -25,7 +26,47 @@ void bfd_instr_description(bft_instr opcode, bft_instr next, FILE* dest) {
                 fprintf(dest, "jump back %u", opcode & BFM_12BIT);
             break;
         case BFK_EXT_IM:
-            switch (opcode) {
+            if (bfu_is_table_instr(opcode)) switch (opcode & BFM_TAB_ID) {
+                case BFI_CYCLIC_MULTI:
+                    fprintf(dest, "add cell value to %u cells", opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_CHG_AT:
+                    fprintf(dest, "increment at %+hi by %u", (int16_t)next, opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_OUTNTIMES_AT: {
+                    int count = opcode & BFM_TAB_ARG;
+                    fprintf(dest, "output character at %+hi", (int16_t)next);
+                    if (count) fprintf(dest, " %i times", count + 1);
+                } break;
+                case BFI_IO_INPUT_AT:
+                    fprintf(dest, "input character at %+hi", (int16_t)next);
+                    break;
+                case BFI_SCAN_RT:
+                    fprintf(dest, "move to right by %u until it's zero", opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_SCAN_LT:
+                    fprintf(dest, "move to left  by %u until it's zero", opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_SET:
+                    fprintf(dest, "set value %hi", (int16_t)next);
+                    break;
+                case BFI_CHG_MOV:
+                    fprintf(dest, "increment by %u, move by %+hi", opcode & BFM_TAB_ARG, (int16_t)next);
+                    break;
+                case BFI_MOV_CHG:
+                    fprintf(dest, "move by %+hi, increment by %u", (int16_t)next, opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_STORE:
+                    fprintf(dest, "store %u cells at %+hi", opcode & BFM_TAB_ARG, (int16_t)next);
+                    break;
+                case BFI_OUTPUT_DATA:
+                    fprintf(dest, "output %u characters", opcode & BFM_TAB_ARG);
+                    break;
+                case BFI_MOV_JNZ:
+                    fprintf(dest, "move by %+hhi, then", (int8_t)(opcode & BFM_TAB_ARG));
+                    break;
+                default: fprintf(dest, "unknown instruction"); break;
+            } else switch (opcode) {
                 case BFI_IO_INPUT: fprintf(dest, "input character"); break;
                 case BFI_BREAKPOINT: fprintf(dest, "breakpoint"); break;
                 case BFI_MEMSET_ZERO: fprintf(dest, "set zero value"); break;
@@ -59,9 +100,10 @@ void bfd_instr_description(bft_instr opcode, bft_instr next, FILE* dest) {
     }
 }
 
-#define bfu_is_long_loop(instr) (((instr) & BFM_KIND_2BIT) == BFK_JMP && ((instr) & BFK_JMP_IS_LONG))
-
-void bfd_instrs_dump_txt(bft_program* prog, FILE* dest, size_t limit) {
+/* Listing of instructions, with counts of runs
+ * and their share of total if counts are given */
+static void bfd_instrs_dump(bft_program* prog, FILE* dest, size_t limit,
+        const uint64_t* counts, uint64_t total) {
     const int address_width = prog->count > 2
         ? floor(log10(prog->count - 2)) + 1 : 1;
 
@@ -69,6 +111,9 @@ void bfd_instrs_dump_txt(bft_program* prog, FILE* dest, size_t limit) {
     bft_instr* instr = prog->items;
     for (size_t i = 0; i < limit && *instr != BFI_DEAD; ++i, ++instr) {
         fprintf(dest, "[%*zu]: %04hx - ", address_width, i, *instr);
+        if (counts)
+            fprintf(dest, "%12llu %6.2f%% - ", (unsigned long long)counts[i],
+                total ? 100.0 * counts[i] / total : 0.0);
 
         if ((*instr & BFM_KIND_3BIT) == BFI_JNZ) --tab;
         fprintf(dest, "%*s", tab * 2, "");
@@ -77,16 +122,184 @@ void bfd_instrs_dump_txt(bft_program* prog, FILE* dest, size_t limit) {
         bfd_instr_description(instr[0], instr[1], dest);
         fputc('\n', dest);
 
-        if (bfu_is_long_loop(*instr))
-            fprintf(dest, "[%*zu]: %04hx\n", address_width, ++i, *++instr);
+        if (bfu_is_table_instr(*instr) && (*instr & BFM_TAB_ID) == BFI_CYCLIC_MULTI) {
+            for (int n = *instr & BFM_TAB_ARG; n > 0; n--, i += 2, instr += 2) {
+                fprintf(dest, "[%*zu]: %04hx %04hx - %*s", address_width,
+                    i + 1, instr[1], instr[2], tab * 2 + 2 + (counts ? 23 : 0), "");
+                fprintf(dest, "at %+hi mul by %hu\n", (int16_t)instr[1], instr[2]);
+            }
+        } else
+            for (size_t n = bfu_instr_size(*instr); n > 1; n--)
+                fprintf(dest, "[%*zu]: %04hx\n", address_width, ++i, *++instr);
     }
 
     if (*instr != BFI_DEAD)
         fprintf(dest, "...\n");
 }
 
+void bfd_instrs_dump_txt(bft_program* prog, FILE* dest, size_t limit) {
+    bfd_instrs_dump(prog, dest, limit, NULL, 0);
+}
+
+static const char* const bfd_op_names[BFO_COUNT] = {
+    [BFO_HALT]          = "halt",
+    [BFO_CHG]           = "change",
+    [BFO_CHG_AT]        = "change at offset",
+    [BFO_MOV]           = "move",
+    [BFO_JEZ]           = "jump if zero",
+    [BFO_JNZ]           = "jump if nonzero",
+    [BFO_INPUT]         = "input",
+    [BFO_INPUT_AT]      = "input at offset",
+    [BFO_OUTPUT]        = "output",
+    [BFO_OUTPUT_AT]     = "output at offset",
+    [BFO_MEMSET_ZERO]   = "set zero",
+    [BFO_SCAN]          = "scan",
+    [BFO_CYCLIC_MOVADD] = "cyclic add",
+    [BFO_CYCLIC_MULTI]  = "cyclic multi-add",
+    [BFO_SET]           = "set",
+    [BFO_CHG_MOV]       = "change and move",
+    [BFO_MOV_CHG]       = "move and change",
+    [BFO_MOV_JNZ]       = "move and jump",
+    [BFO_STORE]         = "store",
+    [BFO_OUTPUT_DATA]   = "output data",
+    [BFO_BREAKPOINT]    = "breakpoint",
+    [BFO_UNKNOWN]       = "unknown",
+    [BFO_NOP]           = "nop",
+};
+
+typedef struct bft_loop {
+    size_t begin, end;
+    uint64_t runs; // instructions run inside of loop
+} bft_loop;
+
+static int bfd_compare_loops(const void* lhs, const void* rhs) {
+    uint64_t lruns = ((const bft_loop*)lhs)->runs;
+    uint64_t rruns = ((const bft_loop*)rhs)->runs;
+    return (lruns < rruns) - (lruns > rruns);
+}
+
+enum { BFD_HOT_LOOPS = 20 };
+
+void bfd_profile_dump_txt(bft_program* prog, const uint64_t* counts, FILE* dest) {
+    uint64_t total = 0, kinds[BFO_COUNT] = {0};
+    bft_op* ops = bfu_decode(prog);
+    uint64_t* sums = malloc((prog->count + 1) * sizeof *sums);
+    bft_loop* loops = malloc(prog->count * sizeof *loops);
+    size_t* stack = malloc(prog->count * sizeof *stack);
+    if (!ops || !sums || !loops || !stack) {
+        fprintf(dest, "not enough memory for profile\n");
+        goto cleanup;
+    }
+
+    sums[0] = 0;
+    for (size_t i = 0; i < prog->count; i++) {
+        total += counts[i];
+        kinds[ops[i].op.kind] += counts[i];
+        sums[i + 1] = total;
+    }
+
+    fprintf(dest, "total %llu instructions\n\n", (unsigned long long)total);
+    bfd_instrs_dump(prog, dest, -1, counts, total);
+
+    fprintf(dest, "\n%12s %7s - operation\n", "runs", "share");
+    for (int kind = 0; kind < BFO_COUNT; kind++)
+        if (kinds[kind]) fprintf(dest, "%12llu %6.2f%% - %s\n",
+            (unsigned long long)kinds[kind], 100.0 * kinds[kind] / total, bfd_op_names[kind]);
+
+    size_t count = 0, depth = 0;
+    for (size_t i = 0; i < prog->count; i += bfu_instr_size(prog->items[i])) {
+        /**/ if (ops[i].op.kind == BFO_JEZ) stack[depth++] = i;
+        else if (ops[i].op.kind == BFO_JNZ && depth > 0) {
+            size_t begin = stack[--depth];
+            loops[count++] = (bft_loop){ begin, i, sums[i + 1] - sums[begin] };
+        }
+    }
+    qsort(loops, count, sizeof *loops, bfd_compare_loops);
+
+    fprintf(dest, "\n%12s %7s %12s %12s - loop\n", "runs", "share", "entries", "iterations");
+    for (size_t i = 0; i < count && i < BFD_HOT_LOOPS && loops[i].runs; i++)
+        fprintf(dest, "%12llu %6.2f%% %12llu %12llu - [%zu..%zu]\n",
+            (unsigned long long)loops[i].runs, 100.0 * loops[i].runs / total,
+            (unsigned long long)counts[loops[i].begin],
+            (unsigned long long)counts[loops[i].end],
+            loops[i].begin, loops[i].end);
+
+cleanup:
+    free(stack);
+    free(loops);
+    free(sums);
+    free(ops);
+}
+
+typedef struct bft_stats_class {
+    const char* name;
+    uint64_t runs;
+} bft_stats_class;
+
+enum { BFD_STATS_CLASSES = 10 };
+
+static void bfd_stats_classes(const bft_stats* stats, bft_stats_class* classes) {
+    classes[0] = (bft_stats_class){ "change",  stats->changes };
+    classes[1] = (bft_stats_class){ "move",    stats->moves };
+    classes[2] = (bft_stats_class){ "loop",    stats->loops };
+    classes[3] = (bft_stats_class){ "set",     stats->sets };
+    classes[4] = (bft_stats_class){ "scan",    stats->scans };
+    classes[5] = (bft_stats_class){ "cyclic",  stats->cyclics };
+    classes[6] = (bft_stats_class){ "fused",   stats->fused };
+    classes[7] = (bft_stats_class){ "input",   stats->inputs };
+    classes[8] = (bft_stats_class){ "output",  stats->outputs };
+    classes[9] = (bft_stats_class){ "other",   stats->others };
+}
+
+void bfd_stats_dump_txt(const bft_stats* stats, FILE* dest) {
+    bft_stats_class classes[BFD_STATS_CLASSES];
+    uint64_t total = 0;
+    bfd_stats_classes(stats, classes);
+    for (int i = 0; i < BFD_STATS_CLASSES; i++) total += classes[i].runs;
+    double io_time = stats->read_time + stats->write_time;
+
+    fprintf(dest, "total %llu instructions\n", (unsigned long long)total);
+    fprintf(dest, "%12s %7s - class\n", "runs", "share");
+    for (int i = 0; i < BFD_STATS_CLASSES; i++)
+        if (classes[i].runs) fprintf(dest, "%12llu %6.2f%% - %s\n",
+            (unsigned long long)classes[i].runs, 100.0 * classes[i].runs / total, classes[i].name);
+    fprintf(dest, "scans: %llu, cells passed: %llu (%.2f per scan), longest: %llu\n",
+        (unsigned long long)stats->scans, (unsigned long long)stats->scan_cells,
+        stats->scans ? (double)stats->scan_cells / stats->scans : 0.0,
+        (unsigned long long)stats->scan_max);
+    fprintf(dest, "input: %llu bytes, %.6f s\n", (unsigned long long)stats->bytes_in, stats->read_time);
+    fprintf(dest, "output: %llu bytes, %.6f s\n", (unsigned long long)stats->bytes_out, stats->write_time);
+    fprintf(dest, "compute: %.6f s of %.6f s\n",
+        stats->total_time > io_time ? stats->total_time - io_time : 0.0, stats->total_time);
+    fprintf(dest, "peak pointer: %zu\n", stats->peak);
+}
+
+void bfd_stats_dump_json(const bft_stats* stats, FILE* dest) {
+    bft_stats_class classes[BFD_STATS_CLASSES];
+    bfd_stats_classes(stats, classes);
+    double io_time = stats->read_time + stats->write_time;
+
+    fprintf(dest, "{\n  \"instructions\": {");
+    for (int i = 0; i < BFD_STATS_CLASSES; i++)
+        fprintf(dest, "%s\"%s\": %llu", i ? ", " : "", classes[i].name,
+            (unsigned long long)classes[i].runs);
+    fprintf(dest, "},\n");
+    fprintf(dest, "  \"scan_cells\": %llu,\n", (unsigned long long)stats->scan_cells);
+    fprintf(dest, "  \"scan_max\": %llu,\n", (unsigned long long)stats->scan_max);
+    fprintf(dest, "  \"bytes_in\": %llu,\n", (unsigned long long)stats->bytes_in);
+    fprintf(dest, "  \"bytes_out\": %llu,\n", (unsigned long long)stats->bytes_out);
+    fprintf(dest, "  \"read_time\": %.6f,\n", stats->read_time);
+    fprintf(dest, "  \"write_time\": %.6f,\n", stats->write_time);
+    fprintf(dest, "  \"compute_time\": %.6f,\n",
+        stats->total_time > io_time ? stats->total_time - io_time : 0.0);
+    fprintf(dest, "  \"total_time\": %.6f,\n", stats->total_time);
+    fprintf(dest, "  \"peak\": %zu\n}\n", stats->peak);
+}
+
 void bfd_memory_dump_txt(bft_context* ctx, FILE* dest, size_t offset, size_t size) {
-    size_t min_size = size < (BFC_MAX_MEMORY - offset) ? size : (BFC_MAX_MEMORY - offset);
+    size_t mem_size = bfu_context_size(ctx);
+    if (offset > mem_size) return;
+    size_t min_size = size < mem_size - offset ? size : mem_size - offset;
     uint8_t buffer[32]; size_t rdlen;
     do {
         rdlen = (min_size >= sizeof buffer) ? sizeof buffer : min_size;
@@ -103,7 +316,9 @@ void bfd_memory_dump_txt(bft_context* ctx, FILE* dest, size_t offset, size_t siz
 }
 
 void bfd_memory_dump_bin(bft_context* ctx, FILE* dest, size_t offset, size_t size) {
-    size_t min_size = size < BFC_MAX_MEMORY - offset ? size : BFC_MAX_MEMORY - offset;
+    size_t mem_size = bfu_context_size(ctx);
+    if (offset > mem_size) return;
+    size_t min_size = size < mem_size - offset ? size : mem_size - offset;
     fwrite(ctx->mem + offset, 1, min_size, dest);
 }
 
@@ -116,7 +331,7 @@ void bfd_memory_dump_loc(bft_context* ctx, FILE* dest) {
     }
     fputc('\n', dest);
 
-    bft_cell *begin = ctx->mem, *end = begin + BFC_MAX_MEMORY, *cell = begin + ctx->mc;
+    bft_cell *begin = ctx->mem, *end = begin + bfu_context_size(ctx), *cell = begin + ctx->mc;
     for (int i = -9; i < 10; i++) {
         bft_cell* cur = cell + i;
         if (begin <= cur && cur < end)
@@ -0,0 +1,242 @@
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+static size_t bfu_jump_dist(const bft_instr* instr) {
+    size_t dist = instr[0] & BFM_12BIT;
+    if (instr[0] & BFK_JMP_IS_LONG)
+        dist = (dist << 16) + instr[1] + 1;
+    return dist;
+}
+
+bft_op* bfu_decode(const bft_program* prog) {
+    bft_op* ops = malloc(prog->count * sizeof *ops);
+    if (!ops) return NULL;
+
+    for (size_t pc = 0; pc < prog->count; pc++) {
+        bft_instr instr = prog->items[pc];
+        bft_op* op = ops + pc;
+        op->arg = op->off = 0;
+
+        switch (instr & BFM_KIND_3BIT) {
+            case BFK_INC: case BFK_DEC:
+                op->op.kind = BFO_CHG;
+                op->arg = bfu_sign_extend_14(instr);
+                break;
+            case BFK_MOV_RT: case BFK_MOV_LT:
+                op->op.kind = BFO_MOV;
+                op->arg = bfu_sign_extend_14(instr);
+                break;
+            case BFI_JEZ: case BFI_JNZ: {
+                bool   zbit = instr & BFM_JMP_ZBIT;
+                size_t dist = bfu_jump_dist(prog->items + pc);
+                size_t next = pc + 1;
+                if (instr & BFK_JMP_IS_LONG) {
+                    ops[next].op.kind = BFO_NOP;
+                    ops[next].arg = ops[next].off = 0;
+                    ++next;
+                }
+                op->op.kind = zbit ? BFO_JNZ : BFO_JEZ;
+                op->arg = zbit ? next - dist : next + dist;
+                pc = next - 1;
+            } break;
+            case BFK_EXT_IM:
+                if (bfu_is_table_instr(instr)) {
+                    op->op.kind = BFO_UNKNOWN;
+                    size_t size = bfu_instr_size(instr);
+                    if (pc + size > prog->count) break;
+                    for (size_t i = 1; i < size; i++)
+                        op[i] = (bft_op){ .op.kind = BFO_NOP };
+
+                    switch (instr & BFM_TAB_ID) {
+                        case BFI_CYCLIC_MULTI:
+                            if ((instr & BFM_TAB_ARG) == 0) break;
+                            op->op.kind = BFO_CYCLIC_MULTI;
+                            op->arg = instr & BFM_TAB_ARG;
+                            for (int32_t i = 0; i < op->arg; i++) {
+                                op[i + 1].off = (int16_t)prog->items[pc + 1 + 2 * i];
+                                op[i + 1].arg = (bft_cell)prog->items[pc + 2 + 2 * i];
+                            }
+                            break;
+                        case BFI_CHG_AT:
+                            op->op.kind = BFO_CHG_AT;
+                            op->arg = (bft_cell)(instr & BFM_TAB_ARG);
+                            break;
+                        case BFI_OUTNTIMES_AT:
+                            op->op.kind = BFO_OUTPUT_AT;
+                            op->arg = (instr & BFM_TAB_ARG) + 1;
+                            break;
+                        case BFI_IO_INPUT_AT:
+                            op->op.kind = BFO_INPUT_AT;
+                            break;
+                        case BFI_SCAN_RT: case BFI_SCAN_LT:
+                            if ((instr & BFM_TAB_ARG) == 0) break;
+                            op->op.kind = BFO_SCAN;
+                            op->arg = instr & BFM_TAB_ARG;
+                            if ((instr & BFM_TAB_ID) == BFI_SCAN_LT) op->arg = -op->arg;
+                            break;
+                        case BFI_SET:
+                            op->op.kind = BFO_SET;
+                            op->arg = (bft_cell)(int16_t)prog->items[pc + 1];
+                            break;
+                        case BFI_CHG_MOV: case BFI_MOV_CHG:
+                            op->op.kind = (instr & BFM_TAB_ID) == BFI_CHG_MOV
+                                ? BFO_CHG_MOV : BFO_MOV_CHG;
+                            op->arg = (bft_cell)(instr & BFM_TAB_ARG);
+                            break;
+                        case BFI_MOV_JNZ: {
+                            const bft_instr* jump = prog->items + pc + 1;
+                            if (pc + 1 >= prog->count || (*jump & BFM_KIND_3BIT) != BFI_JNZ
+                                    || pc + 1 + bfu_instr_size(*jump) > prog->count)
+                                break;
+                            size_t next = pc + 1 + bfu_instr_size(*jump);
+                            size_t dist = bfu_jump_dist(jump);
+                            if (dist > next) break;
+                            op->op.kind = BFO_MOV_JNZ;
+                            op->arg = next - dist;
+                            op->off = (int8_t)(instr & BFM_TAB_ARG);
+                        } break;
+                        case BFI_STORE: case BFI_OUTPUT_DATA: {
+                            size_t first = size - (instr & BFM_TAB_ARG);
+                            if (first == size) break;
+                            op->op.kind = (instr & BFM_TAB_ID) == BFI_STORE
+                                ? BFO_STORE : BFO_OUTPUT_DATA;
+                            op->arg = instr & BFM_TAB_ARG;
+                            if (first == 2) op->off = (int16_t)prog->items[pc + 1];
+                            for (size_t i = first; i < size; i++)
+                                op[i].arg = (bft_cell)prog->items[pc + i];
+                        } break;
+                    }
+                    if (size == 2)
+                        op->off = (int16_t)prog->items[pc + 1];
+                    pc += size - 1;
+                } else switch (instr) {
+                    case BFI_DEAD: op->op.kind = BFO_HALT; break;
+                    case BFI_IO_INPUT: op->op.kind = BFO_INPUT; break;
+                    case BFI_MEMSET_ZERO: op->op.kind = BFO_MEMSET_ZERO; break;
+                    case BFI_MOV_RT_UNTIL_ZERO: op->op.kind = BFO_SCAN; op->arg =  1; break;
+                    case BFI_MOV_LT_UNTIL_ZERO: op->op.kind = BFO_SCAN; op->arg = -1; break;
+                    case BFI_BREAKPOINT: op->op.kind = BFO_BREAKPOINT; break;
+                    default: op->op.kind = BFO_UNKNOWN; break;
+                } break;
+            case BFK_EXT_EX: {
+                int sign = (instr & BFK_EXT_EX_IS_LEFT) ? -1 : 1;
+                switch (instr & BFM_KIND_5BIT) {
+                    case BFI_OUTNTIMES:
+                        op->op.kind = BFO_OUTPUT;
+                        op->arg = (instr & BFM_EX_ARG) + 1;
+                        break;
+                    case BFI_CYCLIC_ADD:
+                        op->op.kind = BFO_CYCLIC_MOVADD;
+                        op->arg = instr & BFM_EX_ARG;
+                        op->off = sign;
+                        break;
+                    case BFI_CYCLIC_MOV:
+                        op->op.kind = BFO_CYCLIC_MOVADD;
+                        op->arg = 1;
+                        op->off = sign * (instr & BFM_EX_ARG);
+                        break;
+                    case BFI_CYCLIC_MOVADD:
+                        op->op.kind = BFO_CYCLIC_MOVADD;
+                        op->arg = instr & 0x1F;
+                        op->off = sign * (instr >> 5 & 0x1F);
+                        break;
+                }
+            } break;
+        }
+    }
+
+    return ops;
+}
+
+/* Count of words occupied by wide instruction */
+static size_t bfu_wide_size(bft_winstr instr) {
+    size_t count = instr >> BFC_WIDE_SHIFT;
+    switch (instr & BFM_WIDE_KIND) {
+        case BFO_CYCLIC_MULTI: return 1 + 2 * count;
+        case BFO_CHG_AT: case BFO_OUTPUT_AT: case BFO_INPUT_AT:
+        case BFO_SET: case BFO_CHG_MOV: case BFO_MOV_CHG: return 2;
+        case BFO_STORE: return 2 + count;
+        case BFO_OUTPUT_DATA: return 1 + count;
+    }
+    return 1;
+}
+
+bft_op* bfu_decode_wide(const bft_wide_program* prog) {
+    bft_op* ops = malloc(prog->count * sizeof *ops);
+    if (!ops) return NULL;
+
+    for (size_t pc = 0; pc < prog->count; pc++) {
+        bft_winstr instr = prog->items[pc];
+        bft_op* op = ops + pc;
+        size_t size = bfu_wide_size(instr);
+        int32_t arg = bfu_sign_extend_24(instr >> BFC_WIDE_SHIFT);
+        size_t target = instr >> BFC_WIDE_SHIFT;
+        *op = (bft_op){ .op.kind = BFO_UNKNOWN };
+        if (pc + size > prog->count) continue;
+        for (size_t i = 1; i < size; i++)
+            op[i] = (bft_op){ .op.kind = BFO_NOP };
+
+        int kind = instr & BFM_WIDE_KIND;
+        switch (kind) {
+            case BFO_HALT: case BFO_INPUT: case BFO_MEMSET_ZERO: case BFO_BREAKPOINT:
+                op->op.kind = kind;
+                break;
+            case BFO_CHG: case BFO_MOV:
+                op->op.kind = kind;
+                op->arg = arg;
+                break;
+            case BFO_OUTPUT: case BFO_SCAN:
+                if (arg == 0) break;
+                op->op.kind = kind;
+                op->arg = arg;
+                break;
+            case BFO_JEZ: case BFO_JNZ:
+                if (target > prog->count) break;
+                op->op.kind = kind;
+                op->arg = target;
+                break;
+            case BFO_MOV_JNZ: {
+                bft_winstr jump = pc + 1 < prog->count ? prog->items[pc + 1] : 0;
+                if ((jump & BFM_WIDE_KIND) != BFO_JNZ || (jump >> BFC_WIDE_SHIFT) > prog->count)
+                    break;
+                op->op.kind = kind;
+                op->arg = jump >> BFC_WIDE_SHIFT;
+                op->off = arg;
+            } break;
+            case BFO_CHG_AT: case BFO_INPUT_AT: case BFO_OUTPUT_AT:
+            case BFO_CHG_MOV: case BFO_MOV_CHG: case BFO_SET:
+                op->op.kind = kind;
+                op->arg = kind == BFO_SET ? (bft_cell)arg : arg;
+                if (kind != BFO_SET) op->off = (int32_t)prog->items[pc + 1];
+                break;
+            case BFO_CYCLIC_MOVADD:
+                op->op.kind = kind;
+                op->arg = (bft_cell)arg;
+                op->off = (int16_t)(instr >> 16);
+                break;
+            case BFO_CYCLIC_MULTI:
+                if (arg <= 0) break;
+                op->op.kind = kind;
+                op->arg = arg;
+                for (int32_t i = 0; i < arg; i++) {
+                    op[i + 1].off = (int32_t)prog->items[pc + 1 + 2 * i];
+                    op[i + 1].arg = (bft_cell)prog->items[pc + 2 + 2 * i];
+                }
+                break;
+            case BFO_STORE: case BFO_OUTPUT_DATA: {
+                size_t first = size - target;
+                if (arg <= 0) break;
+                op->op.kind = kind;
+                op->arg = arg;
+                if (kind == BFO_STORE) op->off = (int32_t)prog->items[pc + 1];
+                for (size_t i = first; i < size; i++)
+                    op[i].arg = (bft_cell)prog->items[pc + i];
+            } break;
+        }
+        pc += size - 1;
+    }
+
+    return ops;
+}
@@ -0,0 +1,172 @@
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdlib.h>
+
+static void bfe_indent(FILE* dest, int depth) {
+    fprintf(dest, "%*s", depth * 4, "");
+}
+
+static void bfe_offset(FILE* dest, int32_t offset) {
+    /**/ if (offset < 0) fprintf(dest, "p - %li", -(long)offset);
+    else if (offset > 0) fprintf(dest, "p + %li",  (long)offset);
+    else fprintf(dest, "p");
+}
+
+static const char* bfe_prologue =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "\n"
+    "static unsigned char m[%d];\n"
+    "\n"
+    "static void corruption(void) {\n"
+    "    fflush(stdout);\n"
+    "    fputs(\"memory corruption\\n\", stderr);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "\n"
+    "#define check(index) if ((index) >= sizeof m) corruption()\n"
+    "#define input(cell) do { int ch = getchar(); cell = ch != EOF ? ch : 0; } while (0)\n"
+    "\n"
+    "int main(void) {\n"
+    "    size_t p = 0;\n"
+    "\n";
+
+static const char* bfe_epilogue =
+    "    return 0;\n"
+    "}\n";
+
+bft_error bfa_emit_c(bft_program* prog, FILE* dest) {
+    if (!prog || !dest) return BFE_NULL_POINTER;
+
+    bft_op* ops = bfu_decode(prog);
+    if (!ops) return BFE_NO_MEMORY;
+
+    bft_error rc = BFE_OK;
+    int depth = 1;
+
+    fprintf(dest, "/* Generated by bfa_emit_c() */\n");
+    fprintf(dest, bfe_prologue, BFC_MAX_MEMORY);
+
+    for (size_t pc = 0; pc < prog->count; pc++) {
+        const bft_op* op = ops + pc;
+        if (op->op.kind == BFO_NOP) continue;
+        if (op->op.kind == BFO_JNZ) --depth;
+        bfe_indent(dest, depth);
+
+        switch (op->op.kind) {
+            case BFO_CHG:
+                fprintf(dest, "m[p] += %i;\n", (int)(bft_cell)op->arg);
+                break;
+            case BFO_CHG_AT:
+                fprintf(dest, "check("); bfe_offset(dest, op->off);
+                fprintf(dest, "); m["); bfe_offset(dest, op->off);
+                fprintf(dest, "] += %li;\n", (long)op->arg);
+                break;
+            case BFO_INPUT_AT:
+                fprintf(dest, "check("); bfe_offset(dest, op->off);
+                fprintf(dest, "); input(m["); bfe_offset(dest, op->off);
+                fprintf(dest, "]);\n");
+                break;
+            case BFO_OUTPUT_AT:
+                fprintf(dest, "check("); bfe_offset(dest, op->off); fprintf(dest, "); ");
+                if (op->arg > 1) fprintf(dest, "for (int i = 0; i < %li; i++) ", (long)op->arg);
+                fprintf(dest, "putchar(m["); bfe_offset(dest, op->off); fprintf(dest, "]);\n");
+                break;
+            case BFO_MOV:
+                fprintf(dest, "p += %li; check(p);\n", (long)op->arg);
+                break;
+            case BFO_JEZ:
+                fprintf(dest, "while (m[p]) {\n"); ++depth;
+                break;
+            case BFO_JNZ:
+                fprintf(dest, "}\n");
+                break;
+            case BFO_INPUT:
+                fprintf(dest, "input(m[p]);\n");
+                break;
+            case BFO_OUTPUT:
+                if (op->arg == 1)
+                    fprintf(dest, "putchar(m[p]);\n");
+                else
+                    fprintf(dest, "for (int i = 0; i < %li; i++) putchar(m[p]);\n", (long)op->arg);
+                break;
+            case BFO_MEMSET_ZERO:
+                fprintf(dest, "m[p] = 0;\n");
+                break;
+            case BFO_SET:
+                fprintf(dest, "m[p] = %i;\n", (int)(bft_cell)op->arg);
+                break;
+            case BFO_CHG_MOV:
+                fprintf(dest, "m[p] += %i; p += %li; check(p);\n",
+                    (int)(bft_cell)op->arg, (long)op->off);
+                break;
+            case BFO_MOV_CHG:
+                fprintf(dest, "p += %li; check(p); m[p] += %i;\n",
+                    (long)op->off, (int)(bft_cell)op->arg);
+                break;
+            case BFO_STORE: case BFO_OUTPUT_DATA: {
+                const bft_op* cells = op + (op->op.kind == BFO_STORE ? 2 : 1);
+                if (op->op.kind == BFO_STORE) {
+                    fprintf(dest, "check("); bfe_offset(dest, op->off);
+                    fprintf(dest, "); check("); bfe_offset(dest, op->off + op->arg - 1);
+                    fprintf(dest, "); ");
+                }
+                fprintf(dest, "{ static const unsigned char d[] = {");
+                for (int32_t i = 0; i < op->arg; i++)
+                    fprintf(dest, "%s%i", i ? ", " : " ", (int)(bft_cell)cells[i].arg);
+                if (op->op.kind == BFO_STORE) {
+                    fprintf(dest, " }; for (int i = 0; i < %li; i++) m[", (long)op->arg);
+                    bfe_offset(dest, op->off); fprintf(dest, " + i] = d[i]; }\n");
+                } else
+                    fprintf(dest, " }; fwrite(d, 1, sizeof d, stdout); }\n");
+            } break;
+            case BFO_MOV_JNZ: // jump is closing brace of loop
+                fprintf(dest, "p += %li; check(p);\n", (long)op->off);
+                break;
+            case BFO_SCAN:
+                /**/ if (op->arg == 1)
+                    fprintf(dest, "while (m[p]) { ++p; check(p); }\n");
+                else if (op->arg == -1)
+                    fprintf(dest, "while (m[p]) { if (p-- == 0) corruption(); }\n");
+                else if (op->arg > 0)
+                    fprintf(dest, "while (m[p]) { p += %li; check(p); }\n", (long)op->arg);
+                else
+                    fprintf(dest, "while (m[p]) { if (p < %li) corruption(); p -= %li; }\n",
+                        -(long)op->arg, -(long)op->arg);
+                break;
+            case BFO_CYCLIC_MOVADD:
+                fprintf(dest, "if (m[p]) { check("); bfe_offset(dest, op->off);
+                fprintf(dest, "); m["); bfe_offset(dest, op->off);
+                fprintf(dest, "] += m[p] * %li; m[p] = 0; }\n", (long)op->arg);
+                break;
+            case BFO_CYCLIC_MULTI:
+                fprintf(dest, "if (m[p]) {\n");
+                for (int32_t i = 1; i <= op->arg; i++) {
+                    bfe_indent(dest, depth + 1); fprintf(dest, "check(");
+                    bfe_offset(dest, op[i].off); fprintf(dest, ");\n");
+                }
+                for (int32_t i = 1; i <= op->arg; i++) {
+                    bfe_indent(dest, depth + 1); fprintf(dest, "m[");
+                    bfe_offset(dest, op[i].off); fprintf(dest, "] += m[p] * %li;\n", (long)op[i].arg);
+                }
+                bfe_indent(dest, depth + 1); fprintf(dest, "m[p] = 0;\n");
+                bfe_indent(dest, depth); fprintf(dest, "}\n");
+                pc += 2 * op->arg;
+                break;
+            case BFO_BREAKPOINT:
+                fprintf(dest, "fflush(stdout); fprintf(stderr, \"breakpoint (pointer on %%zu)\\n\", p);\n");
+                break;
+            case BFO_HALT:
+                fprintf(dest, "fflush(stdout);\n");
+                break;
+            default:
+                bfu_throw(BFE_UNKNOWN_INSTR);
+        }
+    }
+
+    fprintf(dest, "%s", bfe_epilogue);
+
+cleanup:
+    free(ops);
+    return rc;
+}
@@ -0,0 +1,220 @@
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Start of program runs without input on fresh memory, so
+ * it is run at compile time until first input, breakpoint,
+ * halt, memory error or limit of steps. Program is cut at
+ * last instruction outside of loops reached before it, as
+ * no jump crosses such point: instructions before it are
+ * replaced by store of memory, output data and move to
+ * pointer, rest of program is kept as is.
+ */
+
+enum { BFV_MAX_OUTPUT = 1 << 20 };
+
+typedef struct bft_eval {
+    const bft_op* ops;
+    const bool* top;  // operation is outside of loops
+    bft_cell* mem;
+    size_t mc;
+    bft_cell* output;
+    size_t output_count;
+    size_t cut;       // last operation outside of loops
+    uint64_t cut_steps;
+} bft_eval;
+
+static bool bfv_output(bft_eval* ev, bft_cell cell, size_t count) {
+    if (ev->output_count + count > BFV_MAX_OUTPUT) return false;
+    for (size_t i = 0; i < count; i++)
+        ev->output[ev->output_count++] = cell;
+    return true;
+}
+
+static bool bfv_at(size_t mc, int32_t offset, size_t* index) {
+    *index = mc + offset;
+    return *index < BFC_MAX_MEMORY;
+}
+
+/* Runs at most steps operations, stops before operation
+ * which can not be run at compile time */
+static void bfv_run(bft_eval* ev, uint64_t steps) {
+    const bft_op* ops = ev->ops;
+    bft_cell* mem = ev->mem;
+    size_t pc = 0, mc = 0, at;
+    ev->output_count = 0;
+    ev->cut = 0;
+    ev->cut_steps = 0;
+
+    for (uint64_t step = 0; ; step++) {
+        const bft_op* op = ops + pc;
+        if (ev->top[pc]) { ev->cut = pc; ev->cut_steps = step; }
+        if (step == steps) break;
+
+        size_t next = pc + 1;
+        switch (op->op.kind) {
+            case BFO_CHG: mem[mc] += op->arg; break;
+            case BFO_CHG_AT:
+                if (!bfv_at(mc, op->off, &at)) goto stop;
+                mem[at] += op->arg;
+                break;
+            case BFO_MOV:
+                if (!bfv_at(mc, op->arg, &mc)) goto stop;
+                break;
+            case BFO_JEZ: if (!mem[mc]) next = op->arg; break;
+            case BFO_JNZ: if (mem[mc]) next = op->arg; break;
+            case BFO_OUTPUT:
+                if (!bfv_output(ev, mem[mc], op->arg)) goto stop;
+                break;
+            case BFO_OUTPUT_AT:
+                if (!bfv_at(mc, op->off, &at) || !bfv_output(ev, mem[at], op->arg)) goto stop;
+                break;
+            case BFO_MEMSET_ZERO: mem[mc] = 0; break;
+            case BFO_SCAN:
+                at = bfu_scan(mem, BFC_MAX_MEMORY, mc, op->arg);
+                if (at == (size_t)-1) goto stop;
+                mc = at;
+                break;
+            case BFO_CYCLIC_MOVADD:
+                if (!mem[mc]) break;
+                if (!bfv_at(mc, op->off, &at)) goto stop;
+                mem[at] += mem[mc] * op->arg;
+                mem[mc] = 0;
+                break;
+            case BFO_CYCLIC_MULTI:
+                if (mem[mc]) {
+                    for (int32_t i = 1; i <= op->arg; i++)
+                        if (!bfv_at(mc, op[i].off, &at)) goto stop;
+                    for (int32_t i = 1; i <= op->arg; i++)
+                        mem[mc + op[i].off] += mem[mc] * op[i].arg;
+                    mem[mc] = 0;
+                }
+                next += 2 * op->arg;
+                break;
+            case BFO_SET: mem[mc] = op->arg; break;
+            case BFO_CHG_MOV:
+                mem[mc] += op->arg;
+                if (!bfv_at(mc, op->off, &mc)) goto stop;
+                break;
+            case BFO_MOV_CHG:
+                if (!bfv_at(mc, op->off, &mc)) goto stop;
+                mem[mc] += op->arg;
+                break;
+            case BFO_MOV_JNZ:
+                if (!bfv_at(mc, op->off, &mc)) goto stop;
+                if (mem[mc]) next = op->arg;
+                break;
+            case BFO_NOP: break;
+            default: goto stop; // input, breakpoint, halt and others
+        }
+        pc = next;
+    }
+stop:
+    ev->mc = mc;
+}
+
+static bft_error bfv_push(bft_instr** items, size_t* count, size_t* capacity, bft_instr word) {
+    if (*count == *capacity) {
+        *capacity += *capacity == 0 ? 256 : *capacity / 2;
+        bft_instr* grown = realloc(*items, *capacity * sizeof *grown);
+        if (!grown) return BFE_NO_MEMORY;
+        *items = grown;
+    }
+    (*items)[(*count)++] = word;
+    return BFE_OK;
+}
+
+#define bfv_push_word(word) do { \
+    if (bfv_push(&items, &count, &capacity, word)) \
+        bfu_throw(BFE_NO_MEMORY); \
+} while (0)
+
+/* Runs of nonzero cells, short gaps of zeros are stored
+ * with them as they cost less than new instruction */
+static bft_error bfv_lower(const bft_eval* ev, const bft_program* prog, bft_program* result) {
+    bft_instr* items = NULL;
+    size_t count = 0, capacity = 0;
+    bft_error rc = BFE_OK;
+
+    for (size_t i = 0; i < BFC_MAX_MEMORY; i++) {
+        if (!ev->mem[i]) continue;
+        size_t end = i + 1, last = i;
+        while (end < BFC_MAX_MEMORY && end - i < BFC_TAB_ARG_MAX && end - last <= 2) {
+            if (ev->mem[end]) last = end;
+            ++end;
+        }
+        bfv_push_word(BFI_STORE | (last + 1 - i));
+        bfv_push_word(i & BFM_16BIT);
+        for (; i <= last; i++) bfv_push_word(ev->mem[i]);
+        i = last;
+    }
+
+    for (size_t i = 0; i < ev->output_count; i += BFC_TAB_ARG_MAX) {
+        size_t part = ev->output_count - i < BFC_TAB_ARG_MAX ? ev->output_count - i : BFC_TAB_ARG_MAX;
+        bfv_push_word(BFI_OUTPUT_DATA | part);
+        for (size_t j = 0; j < part; j++) bfv_push_word(ev->output[i + j]);
+    }
+
+    for (size_t mc = ev->mc; mc > 0;) {
+        size_t part = mc < BFD_INT14_MAX ? mc : BFD_INT14_MAX;
+        bfv_push_word(BFI_MOV | part);
+        mc -= part;
+    }
+
+    for (size_t i = ev->cut; i < prog->count; i++)
+        bfv_push_word(prog->items[i]);
+
+    result->items = items;
+    result->count = count;
+    result->map = NULL;
+    result->map_size = 0;
+    return rc;
+cleanup:
+    free(items);
+    return rc;
+}
+
+bft_error bfa_evaluate(bft_program* prog, uint64_t steps) {
+    if (!prog) return BFE_NULL_POINTER;
+
+    bft_error rc = BFE_OK;
+    bft_eval ev = {0};
+    bft_op* ops = bfu_decode(prog);
+    bool* top = malloc(prog->count * sizeof *top);
+    ev.mem = malloc(BFC_MAX_MEMORY * sizeof *ev.mem);
+    ev.output = malloc(BFV_MAX_OUTPUT * sizeof *ev.output);
+    if (!ops || !top || !ev.mem || !ev.output) bfu_throw(BFE_NO_MEMORY);
+
+    size_t depth = 0;
+    for (size_t i = 0; i < prog->count; i++) {
+        top[i] = depth == 0 && ops[i].op.kind != BFO_NOP;
+        if (ops[i].op.kind == BFO_JEZ) ++depth;
+        if (ops[i].op.kind == BFO_JNZ && depth > 0) --depth;
+    }
+    ev.ops = ops;
+    ev.top = top;
+
+    memset(ev.mem, 0, BFC_MAX_MEMORY * sizeof *ev.mem);
+    bfv_run(&ev, steps);
+    if (ev.cut == 0) goto cleanup;
+
+    // second run stops exactly at cut with memory and output of it
+    memset(ev.mem, 0, BFC_MAX_MEMORY * sizeof *ev.mem);
+    bfv_run(&ev, ev.cut_steps);
+
+    bft_program result;
+    rc = bfv_lower(&ev, prog, &result);
+    if (rc) goto cleanup;
+    bfa_destroy(prog);
+    *prog = result;
+
+cleanup:
+    free(ev.output);
+    free(ev.mem);
+    free(top);
+    free(ops);
+    return rc;
+}
@@ -3,9 +3,214 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#if BFD_THREADED_DISPATCH
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define bfx_case(kind) L_##kind
+#define bfx_label(kind) [kind] = &&L_##kind
+#define bfx_next() do { op = ip++; goto *op->op.label; } while (0)
+#define bfx_dispatch_begin() bfx_next();
+#define bfx_dispatch_end()
+#else
+#define bfx_case(kind) case kind
+#define bfx_next() continue
+#define bfx_dispatch_begin() while (true) { op = ip++; \
+    if (counts) { ++counts[op - ops]; if (mc > peak) peak = mc; } \
+    switch (op->op.kind) {
+#define bfx_dispatch_end() } }
+#endif
+
+/* Move without bounds check, used on guarded memory
+ * when next operation reads current cell anyway.
+ * Profiling: every operation goes to counting label,
+ * which jumps to label of operation from targets and
+ * keeps highest pointer. Scans of bfa_stats count cells.
+ * Jumps back with budget of steps: cost of iteration
+ * is in off of jump, move-jump reads it from its jump.
+ * Loop entry with range check and unchecked operations
+ * are used by copies of balanced loops (bfx_hoist_checks). */
+enum {
+    BFX_MOV_UNCHECKED = BFO_COUNT,
+    BFX_PROFILE,
+    BFX_JNZ_STEPS,
+    BFX_MOV_JNZ_STEPS,
+    BFX_JEZ_RANGE,     /* off - index of range before copy */
+    BFX_GOTO,          /* arg - address */
+    BFX_CHG_AT_UNCHECKED,
+    BFX_CHG_MOV_UNCHECKED,
+    BFX_MOV_CHG_UNCHECKED,
+    BFX_MOV_JNZ_UNCHECKED,
+    BFX_CYCLIC_MOVADD_UNCHECKED,
+    BFX_CYCLIC_MULTI_UNCHECKED,
+    BFX_SCAN_STATS,
+    BFX_COUNT
+};
+
+#define BFX_NO_LIMIT UINT64_MAX
+
+typedef struct bft_machine {
+    bft_op* ops;
+    size_t  count;    /* operations of program, copies of loops follow */
+    size_t  extra;    /* operations of copies */
+    size_t* origins;  /* address in program of every copied operation */
+    bft_context ctx, *ext_ctx;
+    bft_obuffer output;
+    uint64_t* counts; /* runs of every operation, NULL without profiling */
+    const void** targets;
+    uint64_t steps;   /* budget of bfa_execute_steps or BFX_NO_LIMIT */
+    bft_stats* stats; /* counters of bfa_stats, NULL without them */
+} bft_machine;
+
+static bool bfx_reads_cell(int kind) {
+    switch (kind) {
+        case BFO_CHG: case BFO_JEZ: case BFO_JNZ: case BFO_OUTPUT:
+        case BFO_MEMSET_ZERO: case BFO_SCAN:
+        case BFO_CYCLIC_MOVADD: case BFO_CYCLIC_MULTI:
+        case BFO_SET: case BFO_CHG_MOV:
+            return true;
+    }
+    return false;
+}
+
+static void bfx_unchecked_moves(bft_op* ops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].op.kind != BFO_MOV) continue;
+        size_t next = i + 1;
+        while (next < count && ops[next].op.kind == BFO_NOP) ++next;
+        if (next < count && bfx_reads_cell(ops[next].op.kind)
+                && bfu_abs(ops[i].arg) <= BFD_TAPE_GUARD / (int32_t)sizeof(bft_cell))
+            ops[i].op.kind = BFX_MOV_UNCHECKED;
+    }
+}
+
+/* Operations of loop body outside of nested loops,
+ * which are counted as one operation */
+static void bfx_limit_jumps(bft_op* ops, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int kind = ops[i].op.kind;
+        if (kind == BFO_MOV_JNZ) ops[i].op.kind = BFX_MOV_JNZ_STEPS;
+        if (kind != BFO_JNZ) continue;
+
+        int32_t cost = 1;
+        for (size_t j = ops[i].arg; j < i; j++) {
+            if (ops[j].op.kind == BFO_NOP) continue;
+            if (ops[j].op.kind == BFO_JEZ) j = ops[j].arg - 1;
+            ++cost;
+        }
+        ops[i].off = cost;
+        ops[i].op.kind = BFX_JNZ_STEPS;
+    }
+}
+
+/* Offsets of pointer and cells, which are accessed in
+ * one iteration of innermost loop, so loop is balanced
+ * when pointer returns to its start */
+static bool bfx_loop_range(const bft_op* ops, size_t begin, size_t end,
+        int32_t* low, int32_t* high) {
+    int64_t pos = 0, lo = 0, hi = 0;
+    for (size_t i = begin; i < end; i++) {
+        const bft_op* op = ops + i;
+        int64_t at = pos;
+        switch (op->op.kind) {
+            case BFO_NOP: case BFO_CHG: case BFO_OUTPUT: case BFO_INPUT:
+            case BFO_OUTPUT_AT: case BFO_INPUT_AT: case BFO_MEMSET_ZERO:
+            case BFO_SET: case BFO_STORE: case BFO_OUTPUT_DATA:
+            case BFO_JNZ: case BFX_JNZ_STEPS:
+                continue;
+            case BFO_MOV: pos += op->arg; at = pos; break;
+            case BFO_CHG_MOV: case BFO_MOV_CHG: case BFO_MOV_JNZ: case BFX_MOV_JNZ_STEPS:
+                pos += op->off; at = pos;
+                break;
+            case BFO_CHG_AT: case BFO_CYCLIC_MOVADD: at += op->off; break;
+            case BFO_CYCLIC_MULTI:
+                for (int32_t j = 1; j <= op->arg; j++) {
+                    if (pos + op[j].off < lo) lo = pos + op[j].off;
+                    if (pos + op[j].off > hi) hi = pos + op[j].off;
+                }
+                break;
+            default: return false; // nested loops, scans and others
+        }
+        if (at < lo) lo = at;
+        if (at > hi) hi = at;
+        if (lo < INT32_MIN / 2 || hi > INT32_MAX / 2) return false;
+    }
+    *low = -lo;
+    *high = hi;
+    return pos == 0;
+}
+
+static bool bfx_jumps_back(int kind) {
+    return kind == BFO_JNZ || kind == BFX_JNZ_STEPS
+        || kind == BFO_MOV_JNZ || kind == BFX_MOV_JNZ_STEPS;
+}
+
+static int bfx_unchecked_kind(int kind) {
+    switch (kind) {
+        case BFO_MOV: return BFX_MOV_UNCHECKED;
+        case BFO_CHG_AT: return BFX_CHG_AT_UNCHECKED;
+        case BFO_CHG_MOV: return BFX_CHG_MOV_UNCHECKED;
+        case BFO_MOV_CHG: return BFX_MOV_CHG_UNCHECKED;
+        case BFO_MOV_JNZ: return BFX_MOV_JNZ_UNCHECKED;
+        case BFO_CYCLIC_MOVADD: return BFX_CYCLIC_MOVADD_UNCHECKED;
+        case BFO_CYCLIC_MULTI: return BFX_CYCLIC_MULTI_UNCHECKED;
+    }
+    return kind;
+}
+
+/*
+ * Innermost balanced loops get copy of their body after
+ * program, where moves and accesses at offsets are not
+ * checked. Entry of loop checks range of pointer over one
+ * iteration, which is the same for every iteration, and
+ * runs copy if range is inside of memory, or body as is.
+ * Copy starts with range (arg - distance below pointer,
+ * off - above it) and ends with jump to exit of loop.
+ * Suspended machine saves address of copied operation.
+ */
+static bft_error bfx_hoist_checks(bft_machine* vm) {
+    size_t extra = 0;
+    for (size_t i = 0; i < vm->count; i++) {
+        int32_t lo, hi;
+        if (vm->ops[i].op.kind == BFO_JEZ
+                && bfx_loop_range(vm->ops, i + 1, vm->ops[i].arg, &lo, &hi))
+            extra += vm->ops[i].arg - i + 1;
+    }
+    if (extra == 0) return BFE_OK;
+
+    bft_op* ops = realloc(vm->ops, (vm->count + extra) * sizeof *ops);
+    if (!ops) return BFE_NO_MEMORY;
+    vm->ops = ops;
+    vm->origins = malloc(extra * sizeof *vm->origins);
+    if (!vm->origins) return BFE_NO_MEMORY;
+
+    size_t* origins = vm->origins;
+    size_t copy = vm->count;
+    for (size_t i = 0; i < vm->count; i++) {
+        int32_t lo, hi;
+        size_t exit = ops[i].arg;
+        if (ops[i].op.kind != BFO_JEZ || !bfx_loop_range(ops, i + 1, exit, &lo, &hi))
+            continue;
+
+        ops[copy] = (bft_op){ .op.kind = BFO_NOP, .arg = lo, .off = hi };
+        origins[copy - vm->count] = i;
+        ops[i].op.kind = BFX_JEZ_RANGE;
+        ops[i].off = copy++;
+        size_t start = copy;
+        for (size_t j = i + 1; j < exit; j++, copy++) {
+            ops[copy] = ops[j];
+            ops[copy].op.kind = bfx_unchecked_kind(ops[j].op.kind);
+            if (bfx_jumps_back(ops[j].op.kind)) ops[copy].arg = start;
+            origins[copy - vm->count] = j;
+        }
+        ops[copy] = (bft_op){ .op.kind = BFX_GOTO, .arg = exit };
+        origins[copy++ - vm->count] = exit;
+    }
+    vm->extra = extra;
+    return BFE_OK;
+}
+
 static inline bft_error cyclic_movadd(bft_context* ctx, bft_cell coef, size_t offset) {
     if (ctx->mem[ctx->mc] == 0) return BFE_OK;
-    if (ctx->mc + offset >= BFC_MAX_MEMORY)
+    if (ctx->mc + offset >= ctx->size)
         return BFE_MEMORY_CORRUPTION;
 
     ctx->mem[ctx->mc + offset] += ctx->mem[ctx->mc] * coef;
@@ -13,91 +218,364 @@ static inline bft_error cyclic_movadd(bft_context* ctx, bft_cell coef, size_t of
     return BFE_OK;
 }
 
-bft_error bfa_execute(bft_program* prog, bft_env* env, bft_context* ext_ctx) {
-    if (!prog || !env) return BFE_NULL_POINTER;
-    if (!env->input || !env->output || !env->read || !env->write)
-        return BFE_INVALID_ENV;
+static bft_error bfx_run(void* data) {
+    bft_machine* vm = data;
+    bft_op* ops = vm->ops;
+
+#if BFD_THREADED_DISPATCH
+    static const void* const labels[BFX_COUNT] = {
+        bfx_label(BFO_HALT),
+        bfx_label(BFO_CHG),
+        bfx_label(BFO_CHG_AT),
+        bfx_label(BFO_MOV),
+        bfx_label(BFO_JEZ),
+        bfx_label(BFO_JNZ),
+        bfx_label(BFO_INPUT),
+        bfx_label(BFO_INPUT_AT),
+        bfx_label(BFO_OUTPUT),
+        bfx_label(BFO_OUTPUT_AT),
+        bfx_label(BFO_MEMSET_ZERO),
+        bfx_label(BFO_SCAN),
+        bfx_label(BFO_CYCLIC_MOVADD),
+        bfx_label(BFO_CYCLIC_MULTI),
+        bfx_label(BFO_SET),
+        bfx_label(BFO_CHG_MOV),
+        bfx_label(BFO_MOV_CHG),
+        bfx_label(BFO_MOV_JNZ),
+        bfx_label(BFO_STORE),
+        bfx_label(BFO_OUTPUT_DATA),
+        bfx_label(BFO_BREAKPOINT),
+        bfx_label(BFO_UNKNOWN),
+        bfx_label(BFO_NOP),
+        bfx_label(BFX_MOV_UNCHECKED),
+        bfx_label(BFX_PROFILE),
+        bfx_label(BFX_JNZ_STEPS),
+        bfx_label(BFX_MOV_JNZ_STEPS),
+        bfx_label(BFX_JEZ_RANGE),
+        bfx_label(BFX_GOTO),
+        bfx_label(BFX_CHG_AT_UNCHECKED),
+        bfx_label(BFX_CHG_MOV_UNCHECKED),
+        bfx_label(BFX_MOV_CHG_UNCHECKED),
+        bfx_label(BFX_MOV_JNZ_UNCHECKED),
+        bfx_label(BFX_CYCLIC_MOVADD_UNCHECKED),
+        bfx_label(BFX_CYCLIC_MULTI_UNCHECKED),
+        bfx_label(BFX_SCAN_STATS),
+    };
+    const void** targets = vm->targets;
+    for (size_t i = 0; i < vm->count + vm->extra; i++) {
+        if (targets) targets[i] = labels[ops[i].op.kind];
+        ops[i].op.label = labels[targets ? BFX_PROFILE : ops[i].op.kind];
+    }
+#endif
 
     bft_error rc = BFE_OK;
-    bft_context ctx = {0};
-    if (ext_ctx && ext_ctx->mem)
-        ctx = *ext_ctx;
-    else {
-        ctx.mem = calloc(1, BFC_MAX_MEMORY_BYTES);
-        if (!ctx.mem) return BFE_NO_MEMORY;
+    uint64_t* counts = vm->counts;
+    uint64_t steps = vm->steps;
+    bft_op *ip = ops + vm->ctx.pc, *op;
+    bft_cell* mem = vm->ctx.mem;
+    size_t mc = vm->ctx.mc, size = vm->ctx.size, peak = mc;
+
+    bfx_dispatch_begin()
+#if BFD_THREADED_DISPATCH
+        bfx_case(BFX_PROFILE):
+            ++counts[op - ops];
+            if (mc > peak) peak = mc;
+            goto *targets[op - ops];
+#endif
+        bfx_case(BFO_CHG):
+            mem[mc] += op->arg;
+            bfx_next();
+        bfx_case(BFO_CHG_AT):
+            if (mc + op->off >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            mem[mc + op->off] += op->arg;
+            ++ip; bfx_next();
+        bfx_case(BFO_MOV):
+            mc += op->arg;
+            if (mc >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            bfx_next();
+        bfx_case(BFX_MOV_UNCHECKED):
+            mc += op->arg;
+            bfx_next();
+        bfx_case(BFO_JEZ):
+            if (!mem[mc]) ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFO_JNZ):
+            if (mem[mc]) ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFX_JEZ_RANGE): {
+            bft_op* range = ops + op->off;
+            /**/ if (!mem[mc]) ip = ops + op->arg;
+            else if (mc >= (size_t)range->arg && mc + range->off < size) ip = range + 1;
+        } bfx_next();
+        bfx_case(BFX_GOTO):
+            ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFX_CHG_AT_UNCHECKED):
+            mem[mc + op->off] += op->arg;
+            ++ip; bfx_next();
+        bfx_case(BFX_CHG_MOV_UNCHECKED):
+            mem[mc] += op->arg;
+            mc += op->off;
+            ++ip; bfx_next();
+        bfx_case(BFX_MOV_CHG_UNCHECKED):
+            mc += op->off;
+            mem[mc] += op->arg;
+            ++ip; bfx_next();
+        bfx_case(BFX_MOV_JNZ_UNCHECKED):
+            mc += op->off;
+            if (mem[mc]) ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFX_CYCLIC_MOVADD_UNCHECKED):
+            if (mem[mc]) {
+                mem[mc + op->off] += mem[mc] * op->arg;
+                mem[mc] = 0;
+            }
+            bfx_next();
+        bfx_case(BFX_CYCLIC_MULTI_UNCHECKED): {
+            bft_cell value = mem[mc];
+            if (value) {
+                for (int32_t i = 0; i < op->arg; i++)
+                    mem[mc + ip[i].off] += value * ip[i].arg;
+                mem[mc] = 0;
+            }
+            ip += 2 * op->arg;
+        } bfx_next();
+        bfx_case(BFO_INPUT):
+            if (!bfu_input(&vm->output, mem + mc)) {
+                ip = op; rc = BFE_NEED_INPUT; goto suspend;
+            }
+            bfx_next();
+        bfx_case(BFO_INPUT_AT):
+            if (mc + op->off >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            if (!bfu_input(&vm->output, mem + mc + op->off)) {
+                ip = op; rc = BFE_NEED_INPUT; goto suspend;
+            }
+            ++ip; bfx_next();
+        bfx_case(BFO_OUTPUT_AT):
+            if (mc + op->off >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            bfu_output(&vm->output, mem[mc + op->off], op->arg);
+            ++ip; bfx_next();
+        bfx_case(BFO_OUTPUT):
+            bfu_output(&vm->output, mem[mc], op->arg);
+            bfx_next();
+        bfx_case(BFO_MEMSET_ZERO):
+            mem[mc] = 0;
+            bfx_next();
+        bfx_case(BFO_SCAN):
+            mc = bfu_scan(mem, size, mc, op->arg);
+            if (mc == (size_t)-1)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            bfx_next();
+        bfx_case(BFX_SCAN_STATS): {
+            size_t from = mc;
+            mc = bfu_scan(mem, size, mc, op->arg);
+            if (mc == (size_t)-1)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            uint64_t length = (mc > from ? mc - from : from - mc) / bfu_abs(op->arg);
+            vm->stats->scan_cells += length;
+            if (length > vm->stats->scan_max) vm->stats->scan_max = length;
+        } bfx_next();
+        bfx_case(BFO_CYCLIC_MOVADD):
+            vm->ctx.mc = mc;
+            if (cyclic_movadd(&vm->ctx, op->arg, op->off))
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            bfx_next();
+        bfx_case(BFO_CYCLIC_MULTI): {
+            bft_cell value = mem[mc];
+            if (value) {
+                for (int32_t i = 0; i < op->arg; i++)
+                    if (mc + ip[i].off >= size)
+                        bfu_throw(BFE_MEMORY_CORRUPTION);
+                for (int32_t i = 0; i < op->arg; i++)
+                    mem[mc + ip[i].off] += value * ip[i].arg;
+                mem[mc] = 0;
+            }
+            ip += 2 * op->arg;
+        } bfx_next();
+        bfx_case(BFO_SET):
+            mem[mc] = op->arg;
+            ++ip; bfx_next();
+        bfx_case(BFO_CHG_MOV):
+            mem[mc] += op->arg;
+            mc += op->off;
+            if (mc >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            ++ip; bfx_next();
+        bfx_case(BFO_MOV_CHG):
+            mc += op->off;
+            if (mc >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            mem[mc] += op->arg;
+            ++ip; bfx_next();
+        bfx_case(BFO_MOV_JNZ): // falls to its jump when cell is zero
+            mc += op->off;
+            if (mc >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            if (mem[mc]) ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFX_JNZ_STEPS):
+            if (!mem[mc]) bfx_next();
+            ip = ops + op->arg;
+            if (steps < (uint64_t)op->off) { rc = BFE_YIELD; goto suspend; }
+            steps -= op->off;
+            bfx_next();
+        bfx_case(BFX_MOV_JNZ_STEPS):
+            mc += op->off;
+            if (mc >= size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            if (!mem[mc]) bfx_next();
+            if (steps < (uint64_t)ip->off) { ip = ops + op->arg; rc = BFE_YIELD; goto suspend; }
+            steps -= ip->off;
+            ip = ops + op->arg;
+            bfx_next();
+        bfx_case(BFO_STORE):
+            if (mc + op->off >= size || mc + op->off + op->arg > size)
+                bfu_throw(BFE_MEMORY_CORRUPTION);
+            for (int32_t i = 0; i < op->arg; i++)
+                mem[mc + op->off + i] = ip[1 + i].arg;
+            ip += 1 + op->arg; bfx_next();
+        bfx_case(BFO_OUTPUT_DATA):
+            for (int32_t i = 0; i < op->arg; i++)
+                bfu_output(&vm->output, ip[i].arg, 1);
+            ip += op->arg; bfx_next();
+        bfx_case(BFO_NOP):
+            bfx_next();
+        bfx_case(BFO_BREAKPOINT):
+            rc = BFE_BREAKPOINT;
+        suspend:
+            vm->ctx.pc = ip - ops; vm->ctx.mc = mc;
+            if (vm->ctx.pc >= vm->count)
+                vm->ctx.pc = vm->origins[vm->ctx.pc - vm->count];
+            if (vm->ext_ctx) *vm->ext_ctx = vm->ctx;
+            goto cleanup;
+        bfx_case(BFO_HALT):
+            bfu_throw(BFE_OK);
+        bfx_case(BFO_UNKNOWN):
+            bfu_throw(BFE_UNKNOWN_INSTR);
+    bfx_dispatch_end()
+
+    rc = BFE_UNREACHABLE;
+cleanup:
+    if (vm->stats && peak > vm->stats->peak) vm->stats->peak = peak;
+    return rc;
+}
+
+/* Machine runs decoded operations of narrow or wide
+ * program and releases them */
+static bft_error bfx_execute(bft_op* ops, size_t count, bft_env* env, bft_context* ext_ctx,
+        uint64_t* counts, uint64_t steps, bft_stats* stats) {
+    bft_machine vm;
+    vm.ops = ops;
+    if (!vm.ops) return BFE_NO_MEMORY;
+    vm.count = count;
+    vm.extra = 0;
+    vm.origins = NULL;
+    vm.ext_ctx = ext_ctx;
+    vm.output.env = env; vm.output.count = 0;
+    vm.counts = counts;
+    vm.targets = NULL;
+    vm.steps = steps;
+    vm.stats = stats;
+#if BFD_THREADED_DISPATCH
+    if (counts && !(vm.targets = malloc(vm.count * sizeof *vm.targets))) {
+        free(vm.ops);
+        return BFE_NO_MEMORY;
     }
+#endif
 
-    while (true) {
-        bft_instr instr = prog->items[ctx.pc++];
-        switch (instr & BFM_KIND_3BIT) {
-            case BFK_INC: case BFK_DEC:
-                ctx.mem[ctx.mc] += bfu_sign_extend_14(instr);
-                break;
-            case BFK_MOV_RT: case BFK_MOV_LT:
-                ctx.mc += bfu_sign_extend_14(instr);
-                if (ctx.mc >= BFC_MAX_MEMORY)
-                    bfu_throw(BFE_MEMORY_CORRUPTION);
-                break;
-            case BFI_JEZ: case BFI_JNZ: {
-                bool   zbit = instr & BFM_JMP_ZBIT;
-                size_t dist = instr & BFM_12BIT;
-                if (instr & BFK_JMP_IS_LONG)
-                    dist = (dist << 16) + prog->items[ctx.pc++] + 1;
-                if ((bool)ctx.mem[ctx.mc] == zbit)
-                    ctx.pc += zbit ? -dist : dist;
-            } break;
-            case BFK_EXT_IM:
-                switch (instr) {
-                    case BFI_DEAD: bfu_throw(BFE_OK);
-                    case BFI_IO_INPUT: env->read(env->input, ctx.mem + ctx.mc); break;
-                    case BFI_MEMSET_ZERO: ctx.mem[ctx.mc] = 0; break;
-                    case BFI_MOV_RT_UNTIL_ZERO: {
-                        bft_cell* last_cell = ctx.mem + BFC_MAX_MEMORY - 1;
-                        bft_cell* zero = ctx.mem + ctx.mc;
-                        while (zero < last_cell && *zero != 0) ++zero;
-                        if (*zero) bfu_throw(BFE_MEMORY_CORRUPTION);
-                        ctx.mc = zero - ctx.mem;
-                    } break;
-                    case BFI_MOV_LT_UNTIL_ZERO: {
-                        bft_cell* zero = ctx.mem + ctx.mc;
-                        while (ctx.mem < zero && *zero != 0) --zero;
-                        if (*zero) bfu_throw(BFE_MEMORY_CORRUPTION);
-                        ctx.mc = zero - ctx.mem;
-                    } break;
-                    case BFI_BREAKPOINT:
-                        if (ext_ctx) *ext_ctx = ctx;
-                        bfu_throw(BFE_BREAKPOINT);
-                    default: bfu_throw(BFE_UNKNOWN_INSTR);
-                } break;
-            case BFK_EXT_EX:
-                switch (instr & BFM_KIND_5BIT) {
-                    case BFI_OUTNTIMES:
-                        for (size_t i = 0; i <= (instr & BFM_EX_ARG); i++)
-                            env->write(env->output, ctx.mem[ctx.mc]);
-                        break;
-                    case BFI_CYCLIC_ADD:
-                        if (cyclic_movadd(&ctx, instr & BFM_EX_ARG,
-                            (instr & BFK_EXT_EX_IS_LEFT) ? -1 : 1))
-                            bfu_throw(BFE_MEMORY_CORRUPTION);
-                        break;
-                    case BFI_CYCLIC_MOV: {
-                        size_t movn = instr & BFM_EX_ARG;
-                        if (instr & BFK_EXT_EX_IS_LEFT) movn = -movn;
-                        if (cyclic_movadd(&ctx, 1, movn))
-                            bfu_throw(BFE_MEMORY_CORRUPTION);
-                    } break;
-                    case BFI_CYCLIC_MOVADD: {
-                        size_t movn = instr >> 5 & 0x1F;
-                        if (instr & BFK_EXT_EX_IS_LEFT) movn = -movn;
-                        if (cyclic_movadd(&ctx, instr & 0x1F, movn))
-                            bfu_throw(BFE_MEMORY_CORRUPTION);
-                    } break;
-                } break;
-        }
+    bft_error rc = bfu_tape_acquire(&vm.ctx, ext_ctx);
+    if (rc) { free(vm.targets); free(vm.ops); return rc; }
+
+    if (vm.ctx.flags & BFF_TAPE_GUARDED)
+        bfx_unchecked_moves(vm.ops, vm.count);
+    if (steps != BFX_NO_LIMIT)
+        bfx_limit_jumps(vm.ops, vm.count);
+    for (size_t i = 0; stats && i < vm.count; i++)
+        if (vm.ops[i].op.kind == BFO_SCAN) vm.ops[i].op.kind = BFX_SCAN_STATS;
+    if (!(vm.ctx.flags & BFF_TAPE_GUARDED) && !counts)
+        rc = bfx_hoist_checks(&vm);
+    if (!rc) rc = vm.ctx.mc < vm.ctx.size
+        ? bfu_guarded(&vm.ctx, bfx_run, &vm)
+        : BFE_MEMORY_CORRUPTION;
+
+    bfu_flush(&vm.output);
+    free(vm.origins);
+    free(vm.targets);
+    free(vm.ops);
+    if (!bfu_suspended(rc) || !ext_ctx)
+        bfu_tape_release(&vm.ctx);
+    return rc;
+}
+
+static bft_error bfx_execute_program(bft_program* prog, bft_env* env, bft_context* ext_ctx,
+        uint64_t* counts, uint64_t steps) {
+    if (!prog || !env) return BFE_NULL_POINTER;
+    if (!bfu_valid_env(env)) return BFE_INVALID_ENV;
+    return bfx_execute(bfu_decode(prog), prog->count, env, ext_ctx, counts, steps, NULL);
+}
+
+bft_error bfa_execute(bft_program* prog, bft_env* env, bft_context* ext_ctx) {
+    return bfx_execute_program(prog, env, ext_ctx, NULL, BFX_NO_LIMIT);
+}
+
+bft_error bfa_execute_steps(bft_program* prog, bft_env* env, bft_context* ext_ctx, uint64_t steps) {
+    if (!ext_ctx) return BFE_NULL_POINTER;
+    return bfx_execute_program(prog, env, ext_ctx, NULL, steps);
+}
+
+bft_error bfa_profile(bft_program* prog, bft_env* env, bft_context* ext_ctx, uint64_t* counts) {
+    if (!counts) return BFE_NULL_POINTER;
+    return bfx_execute_program(prog, env, ext_ctx, counts, BFX_NO_LIMIT);
+}
+
+bft_error bfa_execute_wide(bft_wide_program* prog, bft_env* env, bft_context* ext_ctx) {
+    if (!prog || !env) return BFE_NULL_POINTER;
+    if (!bfu_valid_env(env)) return BFE_INVALID_ENV;
+    return bfx_execute(bfu_decode_wide(prog), prog->count, env, ext_ctx, NULL, BFX_NO_LIMIT, NULL);
+}
+
+/* Instructions are counted as by bfa_profile and summed
+ * up by class of their operation after run */
+static uint64_t* bfx_stats_class(bft_stats* stats, int kind) {
+    switch (kind) {
+        case BFO_CHG: case BFO_CHG_AT: return &stats->changes;
+        case BFO_MOV: return &stats->moves;
+        case BFO_JEZ: case BFO_JNZ: return &stats->loops;
+        case BFO_MEMSET_ZERO: case BFO_SET: case BFO_STORE: return &stats->sets;
+        case BFO_SCAN: return &stats->scans;
+        case BFO_CYCLIC_MOVADD: case BFO_CYCLIC_MULTI: return &stats->cyclics;
+        case BFO_CHG_MOV: case BFO_MOV_CHG: case BFO_MOV_JNZ: return &stats->fused;
+        case BFO_INPUT: case BFO_INPUT_AT: return &stats->inputs;
+        case BFO_OUTPUT: case BFO_OUTPUT_AT: case BFO_OUTPUT_DATA: return &stats->outputs;
     }
+    return &stats->others;
+}
 
-    return BFE_UNREACHABLE;
-cleanup:
-    if (rc != BFE_BREAKPOINT) free(ctx.mem);
+bft_error bfa_stats(bft_program* prog, bft_env* env, bft_context* ext_ctx, bft_stats* stats) {
+    if (!prog || !env || !stats) return BFE_NULL_POINTER;
+    if (!bfu_valid_env(env)) return BFE_INVALID_ENV;
+
+    bft_stats_env wrapper;
+    bft_op* ops = NULL;
+    uint64_t* counts = calloc(prog->count, sizeof *counts);
+    if (!counts) return BFE_NO_MEMORY;
+
+    bfu_stats_env(&wrapper, env, stats);
+    double start = bfu_now();
+    bft_error rc = bfx_execute(bfu_decode(prog), prog->count, &wrapper.env, ext_ctx,
+        counts, BFX_NO_LIMIT, stats);
+    stats->total_time += bfu_now() - start;
+
+    if ((ops = bfu_decode(prog)))
+        for (size_t i = 0; i < prog->count; i++)
+            *bfx_stats_class(stats, ops[i].op.kind) += counts[i];
+    else if (!rc)
+        rc = BFE_NO_MEMORY;
+    free(ops);
+    free(counts);
     return rc;
-}
\ No newline at end of file
+}
@@ -0,0 +1,355 @@
+#define _DEFAULT_SOURCE
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BFD_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define BFD_FILE_MMAP 0
+#endif
+
+/* Layout of program file
+ * header (32 bytes), then count instruction words in
+ * native byte order, so file is mapped without copy.
+ * Version is changed with any change of instructions.
+ */
+
+typedef struct bft_file_header {
+    char     magic[4];
+    uint16_t version;
+    uint16_t order;     /* 0x0102 in byte order of writer */
+    uint32_t instr_size;
+    uint32_t checksum;  /* folded hash of instruction words */
+    uint64_t hash;
+    uint64_t count;
+} bft_file_header;
+
+static const char bff_magic[4] = { 'B', 'F', 'B', 'C' };
+
+enum { BFF_VERSION = 5, BFF_ORDER = 0x0102 };
+
+#define BFF_HASH_BASIS 0xCBF29CE484222325ull // FNV-1a
+
+static uint64_t bff_hash_feed(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t bfa_hash(const char* code, size_t size) {
+    return bff_hash_feed(BFF_HASH_BASIS, code, size);
+}
+
+static uint32_t bff_checksum(const bft_instr* items, size_t count) {
+    uint64_t hash = bfa_hash((const char*)items, count * sizeof *items);
+    return (uint32_t)(hash ^ hash >> 32);
+}
+
+/* Check that program can not take machine out of its
+ * instructions: operands fit, jumps land inside, last
+ * instruction is halt. */
+static bool bff_verify(const bft_instr* items, size_t count) {
+    size_t pc = 0, last = 0;
+    while (pc < count) {
+        bft_instr instr = items[pc];
+        size_t size = bfu_instr_size(instr);
+        if (pc + size > count) return false;
+
+        if ((instr & BFM_KIND_2BIT) == BFK_JMP) {
+            size_t dist = instr & BFM_12BIT;
+            if (instr & BFK_JMP_IS_LONG)
+                dist = (dist << 16) + items[pc + 1] + 1;
+            size_t next = pc + size;
+            if (instr & BFM_JMP_ZBIT ? dist > next : next + dist >= count)
+                return false;
+        }
+        last = pc;
+        pc += size;
+    }
+    return count > 0 && items[last] == BFI_DEAD;
+}
+
+bft_error bfa_save(bft_program* prog, uint64_t hash, const char* path) {
+    if (!prog || !path) return BFE_NULL_POINTER;
+
+    bft_file_header header = {0};
+    memcpy(header.magic, bff_magic, sizeof header.magic);
+    header.version = BFF_VERSION;
+    header.order = BFF_ORDER;
+    header.instr_size = sizeof(bft_instr);
+    header.hash = hash;
+    header.count = prog->count;
+    header.checksum = bff_checksum(prog->items, prog->count);
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return BFE_FILE_ERROR;
+    bool written = fwrite(&header, sizeof header, 1, file) == 1
+        && fwrite(prog->items, sizeof *prog->items, prog->count, file) == prog->count;
+    if (fclose(file) != 0) written = false;
+    if (!written) remove(path);
+    return written ? BFE_OK : BFE_FILE_ERROR;
+}
+
+static bft_error bff_check(const void* data, size_t size, uint64_t* hash) {
+    bft_file_header header;
+    if (size < sizeof header) return BFE_INVALID_FORMAT;
+    memcpy(&header, data, sizeof header);
+
+    if (memcmp(header.magic, bff_magic, sizeof header.magic) != 0
+            || header.version != BFF_VERSION || header.order != BFF_ORDER
+            || header.instr_size != sizeof(bft_instr)
+            || header.count != (size - sizeof header) / sizeof(bft_instr)
+            || (size - sizeof header) % sizeof(bft_instr) != 0)
+        return BFE_INVALID_FORMAT;
+
+    const bft_instr* items = (const bft_instr*)((const char*)data + sizeof header);
+    if (header.checksum != bff_checksum(items, header.count)
+            || !bff_verify(items, header.count))
+        return BFE_INVALID_FORMAT;
+    if (hash) *hash = header.hash;
+    return BFE_OK;
+}
+
+/* Content of file is mapped read-only, or read
+ * to allocated memory without mmap */
+#if BFD_FILE_MMAP
+
+static bft_error bff_map(const char* path, void** data, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return BFE_FILE_ERROR;
+    struct stat info;
+    if (fstat(fd, &info) != 0) { close(fd); return BFE_FILE_ERROR; }
+    if (info.st_size <= 0) { close(fd); return BFE_INVALID_FORMAT; }
+
+    *size = info.st_size;
+    *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return *data != MAP_FAILED ? BFE_OK : BFE_FILE_ERROR;
+}
+
+static void bff_unmap(void* data, size_t size) {
+    munmap(data, size);
+}
+
+void bfu_unmap_program(bft_program* prog) {
+    munmap(prog->map, prog->map_size);
+}
+
+#else // not BFD_FILE_MMAP
+
+static bft_error bff_map(const char* path, void** data, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return BFE_FILE_ERROR;
+    char* content = NULL; long length = 0;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0
+            && fseek(file, 0, SEEK_SET) == 0 && (content = malloc(length))
+            && fread(content, length, 1, file) != 1) {
+        free(content); content = NULL;
+    }
+    fclose(file);
+    if (!content) return length > 0 ? BFE_FILE_ERROR : BFE_INVALID_FORMAT;
+    *data = content;
+    *size = length;
+    return BFE_OK;
+}
+
+static void bff_unmap(void* data, size_t size) {
+    (void)size;
+    free(data);
+}
+
+void bfu_unmap_program(bft_program* prog) {
+    (void)prog;
+}
+
+#endif // BFD_FILE_MMAP
+
+bft_error bfa_load(bft_program* prog, uint64_t* hash, const char* path) {
+    if (!prog || !path) return BFE_NULL_POINTER;
+
+    void* data; size_t size;
+    bft_error rc = bff_map(path, &data, &size);
+    if (rc) return rc;
+    rc = bff_check(data, size, hash);
+    if (rc) { bff_unmap(data, size); return rc; }
+
+    size_t count = (size - sizeof(bft_file_header)) / sizeof(bft_instr);
+#if BFD_FILE_MMAP
+    prog->items = (bft_instr*)((char*)data + sizeof(bft_file_header));
+    prog->map = data;
+    prog->map_size = size;
+#else
+    memmove(data, (char*)data + sizeof(bft_file_header), count * sizeof(bft_instr));
+    prog->items = data;
+    prog->map = NULL;
+    prog->map_size = 0;
+#endif
+    prog->count = count;
+    return BFE_OK;
+}
+
+/* Layout of checkpoint file
+ * header (64 bytes), then indices of stored pages of tape
+ * in increasing order, then those pages. Pages of zeros
+ * are skipped, last page is padded with zeros. Hash binds
+ * checkpoint to instructions of program.
+ */
+
+typedef struct bft_checkpoint_header {
+    char     magic[4];
+    uint16_t version;
+    uint16_t order;     /* 0x0102 in byte order of writer */
+    uint32_t cell_size;
+    uint32_t checksum;  /* folded hash of indices and pages */
+    uint32_t flags;     /* flags of tape */
+    uint32_t page_size;
+    uint64_t hash;      /* hash of instruction words */
+    uint64_t pc, mc;
+    uint64_t size;      /* count of cells */
+    uint64_t pages;     /* count of stored pages */
+} bft_checkpoint_header;
+
+static const char bff_checkpoint_magic[4] = { 'B', 'F', 'C', 'P' };
+
+enum { BFF_CHECKPOINT_VERSION = 1, BFF_PAGE_SIZE = 4096 };
+
+static uint64_t bff_program_hash(const bft_program* prog) {
+    return bfa_hash((const char*)prog->items, prog->count * sizeof *prog->items);
+}
+
+/* Copies page of tape, padded with zeros, to buffer and
+ * tells whether it has nonzero bytes */
+static bool bff_page(const bft_context* ctx, size_t size, size_t index, char* page) {
+    size_t bytes = size * sizeof(bft_cell), begin = index * BFF_PAGE_SIZE;
+    size_t length = bytes - begin < BFF_PAGE_SIZE ? bytes - begin : BFF_PAGE_SIZE;
+    memcpy(page, (const char*)ctx->mem + begin, length);
+    memset(page + length, 0, BFF_PAGE_SIZE - length);
+    for (size_t i = 0; i < BFF_PAGE_SIZE; i++)
+        if (page[i]) return true;
+    return false;
+}
+
+bft_error bfa_checkpoint_save(bft_program* prog, const bft_context* ctx, const char* path) {
+    if (!prog || !ctx || !ctx->mem || !path) return BFE_NULL_POINTER;
+
+    size_t size = bfu_context_size(ctx);
+    size_t total = (size * sizeof(bft_cell) + BFF_PAGE_SIZE - 1) / BFF_PAGE_SIZE;
+    uint64_t* indices = malloc(total * sizeof *indices);
+    char* page = malloc(BFF_PAGE_SIZE);
+    if (!indices || !page) { free(indices); free(page); return BFE_NO_MEMORY; }
+
+    bft_checkpoint_header header = {0};
+    memcpy(header.magic, bff_checkpoint_magic, sizeof header.magic);
+    header.version = BFF_CHECKPOINT_VERSION;
+    header.order = BFF_ORDER;
+    header.cell_size = sizeof(bft_cell);
+    header.flags = ctx->flags & BFF_TAPE_EXTERNAL;
+    header.page_size = BFF_PAGE_SIZE;
+    header.hash = bff_program_hash(prog);
+    header.pc = ctx->pc;
+    header.mc = ctx->mc;
+    header.size = size;
+
+    for (size_t i = 0; i < total; i++)
+        if (bff_page(ctx, size, i, page)) indices[header.pages++] = i;
+    uint64_t checksum = bff_hash_feed(BFF_HASH_BASIS,
+        indices, header.pages * sizeof *indices);
+    for (size_t i = 0; i < header.pages; i++) {
+        bff_page(ctx, size, indices[i], page);
+        checksum = bff_hash_feed(checksum, page, BFF_PAGE_SIZE);
+    }
+    header.checksum = (uint32_t)(checksum ^ checksum >> 32);
+
+    FILE* file = fopen(path, "wb");
+    bool written = file
+        && fwrite(&header, sizeof header, 1, file) == 1
+        && fwrite(indices, sizeof *indices, header.pages, file) == header.pages;
+    for (size_t i = 0; written && i < header.pages; i++) {
+        bff_page(ctx, size, indices[i], page);
+        written = fwrite(page, BFF_PAGE_SIZE, 1, file) == 1;
+    }
+    if (file && fclose(file) != 0) written = false;
+    if (file && !written) remove(path);
+    free(page);
+    free(indices);
+    return written ? BFE_OK : BFE_FILE_ERROR;
+}
+
+static bft_error bff_checkpoint_check(const void* data, size_t size, bft_checkpoint_header* header) {
+    if (size < sizeof *header) return BFE_INVALID_FORMAT;
+    memcpy(header, data, sizeof *header);
+
+    uint64_t bytes = header->size * sizeof(bft_cell);
+    uint64_t total = (bytes + BFF_PAGE_SIZE - 1) / BFF_PAGE_SIZE;
+    if (memcmp(header->magic, bff_checkpoint_magic, sizeof header->magic) != 0
+            || header->version != BFF_CHECKPOINT_VERSION || header->order != BFF_ORDER
+            || header->cell_size != sizeof(bft_cell)
+            || header->page_size != BFF_PAGE_SIZE
+            || header->size == 0 || header->size > SIZE_MAX / sizeof(bft_cell)
+            || header->mc >= header->size || header->pages > total
+            || size - sizeof *header != header->pages * (sizeof(uint64_t) + BFF_PAGE_SIZE))
+        return BFE_INVALID_FORMAT;
+
+    const char* body = (const char*)data + sizeof *header;
+    for (uint64_t i = 0; i < header->pages; i++) {
+        uint64_t index, prev = 0;
+        memcpy(&index, body + i * sizeof index, sizeof index);
+        if (i > 0) memcpy(&prev, body + (i - 1) * sizeof prev, sizeof prev);
+        if (index >= total || (i > 0 && index <= prev)) return BFE_INVALID_FORMAT;
+    }
+    uint64_t checksum = bff_hash_feed(BFF_HASH_BASIS, body, size - sizeof *header);
+    if (header->checksum != (uint32_t)(checksum ^ checksum >> 32))
+        return BFE_INVALID_FORMAT;
+    return BFE_OK;
+}
+
+bft_error bfa_checkpoint_load(bft_program* prog, bft_context* ctx, const char* path) {
+    if (!prog || !ctx || !path) return BFE_NULL_POINTER;
+
+    void* data; size_t size;
+    bft_error rc = bff_map(path, &data, &size);
+    if (rc) return rc;
+    bft_checkpoint_header header;
+    rc = bff_checkpoint_check(data, size, &header);
+    if (!rc && (header.hash != bff_program_hash(prog) || header.pc >= prog->count))
+        rc = BFE_PROGRAM_MISMATCH;
+    if (rc) { bff_unmap(data, size); return rc; }
+
+    // tape owned by machine is always of default size
+    if (header.flags & BFF_TAPE_EXTERNAL) {
+        rc = bfa_tape_create(ctx, header.size);
+    } else if (header.size != BFC_MAX_MEMORY) {
+        rc = BFE_INVALID_FORMAT;
+    } else {
+        *ctx = (bft_context){0};
+        ctx->mem = calloc(BFC_MAX_MEMORY, sizeof *ctx->mem);
+        ctx->size = BFC_MAX_MEMORY;
+        if (!ctx->mem) rc = BFE_NO_MEMORY;
+    }
+    if (rc) { bff_unmap(data, size); return rc; }
+
+    const char* body = (const char*)data + sizeof header;
+    const char* pages = body + header.pages * sizeof(uint64_t);
+    size_t bytes = header.size * sizeof(bft_cell);
+    for (uint64_t i = 0; i < header.pages; i++) {
+        uint64_t index;
+        memcpy(&index, body + i * sizeof index, sizeof index);
+        size_t begin = index * BFF_PAGE_SIZE;
+        size_t length = bytes - begin < BFF_PAGE_SIZE ? bytes - begin : BFF_PAGE_SIZE;
+        memcpy((char*)ctx->mem + begin, pages + i * BFF_PAGE_SIZE, length);
+    }
+    ctx->pc = header.pc;
+    ctx->mc = header.mc;
+    bff_unmap(data, size);
+    return BFE_OK;
+}
@@ -0,0 +1,102 @@
+#define _DEFAULT_SOURCE
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <string.h>
+#include <time.h>
+
+bool bfu_valid_env(const bft_env* env) {
+    return env->input && env->output
+        && (env->read  || env->read_block)
+        && (env->write || env->write_block);
+}
+
+void bfu_flush(bft_obuffer* buf) {
+    if (buf->count == 0) return;
+    buf->env->write_block(buf->env->output, buf->items, buf->count);
+    buf->count = 0;
+}
+
+void bfu_output(bft_obuffer* buf, bft_cell cell, size_t count) {
+    bft_env* env = buf->env;
+    if (!env->write_block) {
+        while (count--) env->write(env->output, cell);
+        return;
+    }
+
+    while (count > 0) {
+        size_t free_space = BFD_OUTPUT_BUFFER - buf->count;
+        size_t part = count < free_space ? count : free_space;
+        memset(buf->items + buf->count, cell, part * sizeof cell);
+        buf->count += part;
+        count -= part;
+        if (buf->count == BFD_OUTPUT_BUFFER) bfu_flush(buf);
+    }
+}
+
+bool bfu_input(bft_obuffer* buf, bft_cell* cell) {
+    bft_env* env = buf->env;
+    bfu_flush(buf);
+    if (!env->read_block) {
+        env->read(env->input, cell);
+        return true;
+    }
+    size_t count = env->read_block(env->input, cell, 1);
+    if (count == BFD_WOULD_BLOCK) return false;
+    if (count == 0) *cell = 0;
+    return true;
+}
+
+double bfu_now(void) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void bfu_stats_read(void* data, bft_cell* cell) {
+    bft_stats_env* wrapper = data;
+    double start = bfu_now();
+    wrapper->inner->read(wrapper->inner->input, cell);
+    wrapper->stats->read_time += bfu_now() - start;
+    ++wrapper->stats->bytes_in;
+}
+
+static void bfu_stats_write(void* data, bft_cell cell) {
+    bft_stats_env* wrapper = data;
+    double start = bfu_now();
+    wrapper->inner->write(wrapper->inner->output, cell);
+    wrapper->stats->write_time += bfu_now() - start;
+    ++wrapper->stats->bytes_out;
+}
+
+static size_t bfu_stats_read_block(void* data, bft_cell* cells, size_t count) {
+    bft_stats_env* wrapper = data;
+    double start = bfu_now();
+    count = wrapper->inner->read_block(wrapper->inner->input, cells, count);
+    wrapper->stats->read_time += bfu_now() - start;
+    if (count != BFD_WOULD_BLOCK) wrapper->stats->bytes_in += count;
+    return count;
+}
+
+static void bfu_stats_write_block(void* data, const bft_cell* cells, size_t count) {
+    bft_stats_env* wrapper = data;
+    double start = bfu_now();
+    wrapper->inner->write_block(wrapper->inner->output, cells, count);
+    wrapper->stats->write_time += bfu_now() - start;
+    wrapper->stats->bytes_out += count;
+}
+
+void bfu_stats_env(bft_stats_env* wrapper, bft_env* env, bft_stats* stats) {
+    wrapper->env = (bft_env){
+        wrapper, wrapper,
+        env->read  ? bfu_stats_read  : NULL,
+        env->write ? bfu_stats_write : NULL,
+        env->read_block  ? bfu_stats_read_block  : NULL,
+        env->write_block ? bfu_stats_write_block : NULL,
+    };
+    wrapper->inner = env;
+    wrapper->stats = stats;
+}
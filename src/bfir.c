@@ -0,0 +1,643 @@
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Optimizer works on list of operations lifted from words
+ * of parser: operands are full-width, fused instructions
+ * are split back, loops are pairs of BFO_JEZ and BFO_JNZ
+ * linked by index of each other. Every pass reads list and
+ * appends its result to new one, then list is lowered to
+ * words again: operands which do not fit encoding take
+ * several instructions, jumps are long only when their
+ * final distance needs it. Wide instructions are lowered
+ * from the same list, their operands fit almost always.
+ *
+ * Passes by level of optimizations:
+ *   1 - combine neighbours, drop dead stores (bfr_combine)
+ *   2 - fuse pairs into superinstructions (bfr_fuse)
+ *   3 - fold linear loops on known counter (bfr_fold)
+ */
+
+typedef struct bft_rop {
+    int kind;          /* BFO_* */
+    int32_t arg, off;  /* as in bft_op, except jumps */
+    size_t link;       /* pair of jump, first operand in pool of
+                          cyclic multi, store and output data */
+} bft_rop;
+
+typedef struct bft_rcell {
+    int32_t off;
+    bft_cell value;    /* coefficient of cyclic multi */
+} bft_rcell;
+
+typedef struct bft_ir {
+    bft_rop* ops;
+    size_t count, capacity;
+    size_t* opens;     /* opening jumps without pair */
+    size_t depth;
+    bft_rcell* pool;
+    size_t pool_count, pool_capacity;
+    bool wide;         /* list is lowered to wide instructions */
+} bft_ir;
+
+static bool bfr_is_jump(int kind) {
+    return kind == BFO_JEZ || kind == BFO_JNZ || kind == BFO_MOV_JNZ;
+}
+
+/* Delta of cell change with least absolute value */
+static int32_t bfr_delta(int64_t delta) {
+    bft_cell up = (bft_cell)delta, down = (bft_cell)-delta;
+    return up <= down ? up : -(int32_t)down;
+}
+
+static bft_error bfr_push(bft_ir* ir, bft_rop op) {
+    if (ir->count == ir->capacity) {
+        size_t capacity = ir->capacity == 0 ? 256 : ir->capacity * 2;
+        bft_rop* ops = realloc(ir->ops, capacity * sizeof *ops);
+        if (!ops) return BFE_NO_MEMORY;
+        ir->ops = ops;
+        ir->capacity = capacity;
+    }
+    /**/ if (op.kind == BFO_JEZ) ir->opens[ir->depth++] = ir->count;
+    else if (bfr_is_jump(op.kind)) {
+        if (ir->depth == 0) return BFE_UNBALANCED_BRACKETS;
+        op.link = ir->opens[--ir->depth];
+        ir->ops[op.link].link = ir->count;
+    }
+    ir->ops[ir->count++] = op;
+    return BFE_OK;
+}
+
+static bft_error bfr_push_cell(bft_ir* ir, int32_t off, bft_cell value) {
+    if (ir->pool_count == ir->pool_capacity) {
+        size_t capacity = ir->pool_capacity == 0 ? 64 : ir->pool_capacity * 2;
+        bft_rcell* pool = realloc(ir->pool, capacity * sizeof *pool);
+        if (!pool) return BFE_NO_MEMORY;
+        ir->pool = pool;
+        ir->pool_capacity = capacity;
+    }
+    ir->pool[ir->pool_count++] = (bft_rcell){ off, value };
+    return BFE_OK;
+}
+
+#define bfr_push_op(ir, ...) do { \
+    if ((rc = bfr_push(ir, (bft_rop){ __VA_ARGS__ }))) \
+        goto cleanup; \
+} while (0)
+
+static bft_error bfr_lift(const bft_program* prog, bft_ir* ir) {
+    bft_error rc = BFE_OK;
+    bft_op* ops = bfu_decode(prog);
+    ir->opens = malloc(prog->count * sizeof *ir->opens);
+    if (!ops || !ir->opens) bfu_throw(BFE_NO_MEMORY);
+
+    for (size_t pc = 0; pc < prog->count; pc++) {
+        const bft_op* op = ops + pc;
+        size_t first = ir->pool_count;
+        switch (op->op.kind) {
+            case BFO_NOP: break;
+            case BFO_UNKNOWN: bfu_throw(BFE_UNKNOWN_INSTR);
+            case BFO_CHG_MOV:
+                bfr_push_op(ir, BFO_CHG, op->arg, 0, 0);
+                bfr_push_op(ir, BFO_MOV, op->off, 0, 0);
+                break;
+            case BFO_MOV_CHG:
+                bfr_push_op(ir, BFO_MOV, op->off, 0, 0);
+                bfr_push_op(ir, BFO_CHG, op->arg, 0, 0);
+                break;
+            case BFO_MOV_JNZ: // jump follows as next word
+                bfr_push_op(ir, BFO_MOV, op->off, 0, 0);
+                break;
+            case BFO_CYCLIC_MULTI: case BFO_STORE: case BFO_OUTPUT_DATA: {
+                const bft_op* cell = op + (op->op.kind == BFO_STORE ? 2 : 1);
+                for (int32_t i = 0; i < op->arg; i++) {
+                    int32_t off = op->op.kind == BFO_CYCLIC_MULTI ? cell[i].off : 0;
+                    if (bfr_push_cell(ir, off, cell[i].arg)) bfu_throw(BFE_NO_MEMORY);
+                }
+                bfr_push_op(ir, op->op.kind, op->arg, op->off, first);
+            } break;
+            default:
+                bfr_push_op(ir, op->op.kind, op->arg, op->off, 0);
+                break;
+        }
+    }
+    if (ir->depth) rc = BFE_UNBALANCED_BRACKETS;
+cleanup:
+    free(ops);
+    return rc;
+}
+
+/* Merges operation into previous one, which is not jump
+ * unless operation has no effect after it */
+static bool bfr_merge(bft_rop* prev, const bft_rop* op) {
+    int64_t sum = (int64_t)prev->arg + op->arg;
+    switch (op->kind) {
+        case BFO_CHG:
+            /**/ if (prev->kind == BFO_CHG) prev->arg = bfr_delta(sum);
+            else if (prev->kind == BFO_SET) prev->arg = (bft_cell)sum;
+            else return false;
+            return true;
+        case BFO_MOV:
+            if (prev->kind != BFO_MOV || sum < INT32_MIN || sum > INT32_MAX) return false;
+            prev->arg = sum;
+            return true;
+        case BFO_CHG_AT:
+            if (prev->kind != BFO_CHG_AT || prev->off != op->off) return false;
+            prev->arg = bfr_delta(sum);
+            return true;
+        case BFO_OUTPUT: case BFO_OUTPUT_AT:
+            if (prev->kind != op->kind || prev->off != op->off || sum > INT32_MAX) return false;
+            prev->arg = sum;
+            return true;
+        case BFO_MEMSET_ZERO: // cell is zero after these
+            return prev->kind == BFO_MEMSET_ZERO || prev->kind == BFO_SCAN
+                || prev->kind == BFO_JNZ || prev->kind == BFO_CYCLIC_MOVADD
+                || prev->kind == BFO_CYCLIC_MULTI;
+    }
+    return false;
+}
+
+static bool bfr_is_noop(const bft_rop* op) {
+    return (op->kind == BFO_CHG || op->kind == BFO_MOV || op->kind == BFO_CHG_AT)
+        && op->arg == 0;
+}
+
+/* Store to current cell with no reads before next store */
+static bool bfr_is_store(int kind) {
+    return kind == BFO_CHG || kind == BFO_SET || kind == BFO_MEMSET_ZERO;
+}
+
+static bft_error bfr_combine(bft_ir* ir, const bft_rop* ops, size_t count) {
+    bft_error rc = BFE_OK;
+    for (size_t i = 0; i < count; i++) {
+        bft_rop op = ops[i];
+        bft_rop* prev = ir->count ? ir->ops + ir->count - 1 : NULL;
+        if (prev && bfr_merge(prev, &op)) {
+            if (bfr_is_noop(prev)) --ir->count;
+            continue;
+        }
+        if (bfr_is_noop(&op)) continue;
+        if (op.kind == BFO_SET || op.kind == BFO_MEMSET_ZERO)
+            while (ir->count && bfr_is_store(ir->ops[ir->count - 1].kind)) --ir->count;
+        bfr_push_op(ir, op.kind, op.arg, op.off, op.link);
+    }
+cleanup:
+    return rc;
+}
+
+/* Delta of cell change fits into arg of table instruction */
+static bool bfr_fits_tab_delta(int32_t delta) {
+    return (bft_cell)(delta & BFM_TAB_ARG) == (bft_cell)delta;
+}
+
+static bool bfr_fits(int32_t value, int32_t min, int32_t max) {
+    return value >= min && value <= max;
+}
+
+/*
+ * Frequent pairs of operations are fused into
+ * superinstructions: [-]+ to set, +> to change-move,
+ * >+ to move-change and >] to move-jump. Second operation
+ * of pair is never target of jump, as jumps land only
+ * after other jumps. Wide instructions fuse any of them
+ * except move-jump beyond their operand.
+ */
+static bft_error bfr_fuse(bft_ir* ir, const bft_rop* ops, size_t count) {
+    bft_error rc = BFE_OK;
+    bool wide = ir->wide;
+    for (size_t i = 0; i < count; i++) {
+        bft_rop op = ops[i], next = i + 1 < count ? ops[i + 1] : (bft_rop){ BFO_HALT, 0, 0, 0 };
+        bool fused = true;
+        /**/ if (op.kind == BFO_MEMSET_ZERO && next.kind == BFO_CHG)
+            op = (bft_rop){ BFO_SET, (bft_cell)next.arg, 0, 0 };
+        else if (op.kind == BFO_CHG && next.kind == BFO_MOV && (wide || (bfr_fits_tab_delta(op.arg)
+                && bfr_fits(next.arg, INT16_MIN, INT16_MAX))))
+            op = (bft_rop){ BFO_CHG_MOV, op.arg, next.arg, 0 };
+        else if (op.kind == BFO_MOV && next.kind == BFO_JNZ && (wide
+                ? bfr_fits(op.arg, BFD_INT24_MIN, BFD_INT24_MAX)
+                : bfr_fits(op.arg, INT8_MIN, INT8_MAX)))
+            op = (bft_rop){ BFO_MOV_JNZ, 0, op.arg, 0 };
+        else if (op.kind == BFO_MOV && next.kind == BFO_CHG && (wide || (bfr_fits_tab_delta(next.arg)
+                && bfr_fits(op.arg, INT16_MIN, INT16_MAX))))
+            op = (bft_rop){ BFO_MOV_CHG, next.arg, op.arg, 0 };
+        else
+            fused = false;
+        if (fused) ++i;
+        bfr_push_op(ir, op.kind, op.arg, op.off, op.link);
+    }
+cleanup:
+    return rc;
+}
+
+/*
+ * Values of cells are tracked along straight code as in
+ * parser, relative to pointer at start of tracking. Linear
+ * loop on cell of known value adds known multiples to its
+ * targets, so it is replaced by clear and changes at
+ * offsets. Loops on known zero cell are removed.
+ */
+enum { BFR_KNOWN_CELLS = 16 };
+
+typedef struct bft_rknown {
+    int64_t at;        /* offset of pointer */
+    struct { int64_t off; bft_cell value; } cells[BFR_KNOWN_CELLS];
+    size_t count;
+    bool opaque;       /* cells not in list may be nonzero */
+} bft_rknown;
+
+static bft_cell* bfr_known(bft_rknown* known, int64_t off) {
+    for (size_t i = 0; i < known->count; i++)
+        if (known->cells[i].off == known->at + off) return &known->cells[i].value;
+    return NULL;
+}
+
+static void bfr_know(bft_rknown* known, int64_t off, bft_cell value) {
+    bft_cell* cell = bfr_known(known, off);
+    if (cell) { *cell = value; return; }
+    if (known->count == BFR_KNOWN_CELLS) {
+        known->count = 0;
+        known->opaque = true;
+    }
+    known->cells[known->count].off = known->at + off;
+    known->cells[known->count++].value = value;
+}
+
+static void bfr_change(bft_rknown* known, int64_t off, bft_cell delta) {
+    bft_cell* cell = bfr_known(known, off);
+    /**/ if (cell) *cell += delta;
+    else if (!known->opaque) bfr_know(known, off, delta);
+}
+
+static void bfr_forget(bft_rknown* known, int64_t off) {
+    for (size_t i = 0; i < known->count; i++)
+        if (known->cells[i].off == known->at + off) {
+            known->cells[i] = known->cells[--known->count];
+            break;
+        }
+    known->opaque = true;
+}
+
+static void bfr_forget_all(bft_rknown* known) {
+    known->count = 0;
+    known->opaque = true;
+}
+
+static bft_error bfr_fold(bft_ir* ir, const bft_rop* ops, size_t count) {
+    bft_error rc = BFE_OK;
+    bft_rknown known = {0}; // memory is zero at start
+
+    for (size_t i = 0; i < count; i++) {
+        bft_rop op = ops[i];
+        bft_cell* value = bfr_known(&known, 0);
+        bool zero = value ? *value == 0 : !known.opaque;
+
+        switch (op.kind) {
+            case BFO_CHG: bfr_change(&known, 0, op.arg); break;
+            case BFO_CHG_AT: bfr_change(&known, op.off, op.arg); break;
+            case BFO_SET: bfr_know(&known, 0, op.arg); break;
+            case BFO_MEMSET_ZERO: bfr_know(&known, 0, 0); break;
+            case BFO_MOV: known.at += op.arg; break;
+            case BFO_STORE:
+                for (int32_t j = 0; j < op.arg; j++)
+                    bfr_know(&known, op.off + j, ir->pool[op.link + j].value);
+                break;
+            case BFO_INPUT: bfr_forget(&known, 0); break;
+            case BFO_INPUT_AT: bfr_forget(&known, op.off); break;
+            case BFO_SCAN: bfr_forget_all(&known); bfr_know(&known, 0, 0); break;
+            case BFO_BREAKPOINT: bfr_forget_all(&known); break;
+            case BFO_JEZ:
+                if (zero) { i = op.link; continue; } // loop never runs
+                bfr_forget_all(&known);
+                break;
+            case BFO_JNZ: bfr_forget_all(&known); bfr_know(&known, 0, 0); break;
+            case BFO_CYCLIC_MOVADD: case BFO_CYCLIC_MULTI: {
+                bft_rcell single = { op.off, op.arg };
+                const bft_rcell* targets = op.kind == BFO_CYCLIC_MULTI ? ir->pool + op.link : &single;
+                size_t target_count = op.kind == BFO_CYCLIC_MULTI ? (size_t)op.arg : 1;
+                if (zero) continue;
+                if (!value) {
+                    for (size_t j = 0; j < target_count; j++)
+                        bfr_forget(&known, targets[j].off);
+                    bfr_know(&known, 0, 0);
+                    break;
+                }
+                bft_cell counter = *value;
+                bfr_push_op(ir, BFO_MEMSET_ZERO, 0, 0, 0);
+                bfr_know(&known, 0, 0);
+                for (size_t j = 0; j < target_count; j++) {
+                    bft_cell delta = targets[j].value * counter;
+                    bfr_push_op(ir, BFO_CHG_AT, bfr_delta(delta), targets[j].off, 0);
+                    bfr_change(&known, targets[j].off, delta);
+                }
+            } continue;
+        }
+        bfr_push_op(ir, op.kind, op.arg, op.off, op.link);
+    }
+cleanup:
+    return rc;
+}
+
+typedef bft_error (*bft_rpass)(bft_ir* ir, const bft_rop* ops, size_t count);
+
+/* Pass appends new list to emptied representation */
+static bft_error bfr_run_pass(bft_ir* ir, bft_rpass pass) {
+    bft_rop* ops = ir->ops;
+    size_t count = ir->count;
+    ir->ops = NULL;
+    ir->count = ir->capacity = ir->depth = 0;
+    bft_error rc = pass(ir, ops, count);
+    free(ops);
+    return rc;
+}
+
+#define bfr_emit(word) do { \
+    if (dest) dest[size] = (word); \
+    ++size; \
+} while (0)
+
+/* Splits value into instructions of signed 14-bit operand */
+static size_t bfr_encode_split(int64_t value, bft_instr type, bft_instr* dest) {
+    size_t size = 0;
+    while (value != 0) {
+        int64_t part = value > BFD_INT14_MAX ? BFD_INT14_MAX
+            : value < BFD_INT14_MIN ? BFD_INT14_MIN : value;
+        bfr_emit(type | (part & BFM_14BIT));
+        value -= part;
+    }
+    return size;
+}
+
+/* Jump of distance from next instruction, long jump
+ * keeps distance less by one as in parser */
+static size_t bfr_encode_jump(bft_instr type, size_t dist, bool is_long, bft_instr* dest) {
+    size_t size = 0;
+    if (!is_long) { bfr_emit(type | dist); return size; }
+    bfr_emit(type | BFK_JMP_IS_LONG | (dist - 1) >> 16);
+    bfr_emit((dist - 1) & BFM_16BIT);
+    return size;
+}
+
+/* Words of operation, only counted without dest */
+static size_t bfr_encode(const bft_ir* ir, const bft_rop* op, size_t dist, bool is_long, bft_instr* dest) {
+    size_t size = 0;
+    int32_t abs_off = bfu_abs(op->off);
+    bft_instr left = op->off < 0 ? BFK_EXT_EX_IS_LEFT : 0;
+    switch (op->kind) {
+        case BFO_HALT: bfr_emit(BFI_DEAD); break;
+        case BFO_CHG: return bfr_encode_split(op->arg, BFI_CHG, dest);
+        case BFO_MOV: return bfr_encode_split(op->arg, BFI_MOV, dest);
+        case BFO_JEZ: return bfr_encode_jump(BFI_JEZ, dist, is_long, dest);
+        case BFO_JNZ: return bfr_encode_jump(BFI_JNZ, dist, is_long, dest);
+        case BFO_MOV_JNZ:
+            bfr_emit(BFI_MOV_JNZ | (op->off & BFM_TAB_ARG));
+            return size + bfr_encode_jump(BFI_JNZ, dist, is_long, dest ? dest + size : NULL);
+        case BFO_INPUT: bfr_emit(BFI_IO_INPUT); break;
+        case BFO_INPUT_AT:
+            bfr_emit(BFI_IO_INPUT_AT);
+            bfr_emit(op->off & BFM_16BIT);
+            break;
+        case BFO_OUTPUT:
+            for (int32_t rest = op->arg, part; rest > 0; rest -= part) {
+                part = rest > BFC_EX_ARG_MAX + 1 ? BFC_EX_ARG_MAX + 1 : rest;
+                bfr_emit(BFI_OUTNTIMES | (part - 1));
+            }
+            break;
+        case BFO_OUTPUT_AT:
+            for (int32_t rest = op->arg, part; rest > 0; rest -= part) {
+                part = rest > BFC_TAB_ARG_MAX + 1 ? BFC_TAB_ARG_MAX + 1 : rest;
+                bfr_emit(BFI_OUTNTIMES_AT | (part - 1));
+                bfr_emit(op->off & BFM_16BIT);
+            }
+            break;
+        case BFO_MEMSET_ZERO: bfr_emit(BFI_MEMSET_ZERO); break;
+        case BFO_SCAN:
+            /**/ if (op->arg ==  1) bfr_emit(BFI_MOV_RT_UNTIL_ZERO);
+            else if (op->arg == -1) bfr_emit(BFI_MOV_LT_UNTIL_ZERO);
+            else bfr_emit((op->arg > 0 ? BFI_SCAN_RT : BFI_SCAN_LT) | bfu_abs(op->arg));
+            break;
+        case BFO_CYCLIC_MOVADD:
+            /**/ if (abs_off == 1)
+                bfr_emit(BFI_CYCLIC_ADD | left | (op->arg & BFM_EX_ARG));
+            else if (op->arg == 1 && abs_off <= BFC_EX_ARG_MAX)
+                bfr_emit(BFI_CYCLIC_MOV | left | abs_off);
+            else if (op->arg < 32 && abs_off < 32)
+                bfr_emit(BFI_CYCLIC_MOVADD | left | abs_off << 5 | op->arg);
+            else {
+                bfr_emit(BFI_CYCLIC_MULTI | 1);
+                bfr_emit(op->off & BFM_16BIT);
+                bfr_emit(op->arg);
+            }
+            break;
+        case BFO_CYCLIC_MULTI:
+            bfr_emit(BFI_CYCLIC_MULTI | op->arg);
+            for (int32_t i = 0; i < op->arg; i++) {
+                bfr_emit(ir->pool[op->link + i].off & BFM_16BIT);
+                bfr_emit(ir->pool[op->link + i].value);
+            }
+            break;
+        case BFO_CHG_AT:
+            bfr_emit(BFI_CHG_AT | (op->arg & BFM_TAB_ARG));
+            bfr_emit(op->off & BFM_16BIT);
+            break;
+        case BFO_SET:
+            bfr_emit(BFI_SET);
+            bfr_emit(bfr_delta(op->arg) & BFM_16BIT);
+            break;
+        case BFO_CHG_MOV: case BFO_MOV_CHG:
+            bfr_emit((op->kind == BFO_CHG_MOV ? BFI_CHG_MOV : BFI_MOV_CHG) | (op->arg & BFM_TAB_ARG));
+            bfr_emit(op->off & BFM_16BIT);
+            break;
+        case BFO_STORE: case BFO_OUTPUT_DATA:
+            bfr_emit((op->kind == BFO_STORE ? BFI_STORE : BFI_OUTPUT_DATA) | op->arg);
+            if (op->kind == BFO_STORE) bfr_emit(op->off & BFM_16BIT);
+            for (int32_t i = 0; i < op->arg; i++)
+                bfr_emit(ir->pool[op->link + i].value);
+            break;
+        case BFO_BREAKPOINT: bfr_emit(BFI_BREAKPOINT); break;
+    }
+    return size;
+}
+
+/* Distance of jump from instruction after it, by
+ * addresses of operations at current lengths of jumps */
+static size_t bfr_jump_dist(const bft_ir* ir, const size_t* addrs, size_t i) {
+    size_t pair = ir->ops[i].link;
+    return ir->ops[i].kind == BFO_JEZ
+        ? addrs[pair + 1] - addrs[i + 1]
+        : addrs[i + 1] - addrs[pair + 1];
+}
+
+static bft_error bfr_lower(const bft_ir* ir, bft_program* prog) {
+    bft_error rc = BFE_OK;
+    size_t* addrs = malloc((ir->count + 1) * sizeof *addrs);
+    bool* longs = calloc(ir->count + 1, sizeof *longs);
+    bft_instr* items = NULL;
+    if (!addrs || !longs) bfu_throw(BFE_NO_MEMORY);
+
+    // jumps only grow, so lengths settle in few rounds
+    for (bool grown = true; grown;) {
+        grown = false;
+        addrs[0] = 0;
+        for (size_t i = 0; i < ir->count; i++)
+            addrs[i + 1] = addrs[i] + bfr_encode(ir, ir->ops + i, 0, longs[i], NULL);
+        for (size_t i = 0; i < ir->count; i++) {
+            if (!bfr_is_jump(ir->ops[i].kind) || longs[i]) continue;
+            if (bfr_jump_dist(ir, addrs, i) > BFC_MAX_JUMP_SH_DIST) longs[i] = grown = true;
+        }
+    }
+
+    items = malloc(addrs[ir->count] * sizeof *items);
+    if (!items) bfu_throw(BFE_NO_MEMORY);
+    for (size_t i = 0; i < ir->count; i++) {
+        size_t dist = bfr_is_jump(ir->ops[i].kind) ? bfr_jump_dist(ir, addrs, i) : 0;
+        if (dist > BFC_MAX_JUMP_LO_DIST) bfu_throw(BFE_VERY_LONG_JUMP);
+        bfr_encode(ir, ir->ops + i, dist, longs[i], items + addrs[i]);
+    }
+
+    prog->items = items;
+    prog->count = addrs[ir->count];
+    prog->map = NULL;
+    prog->map_size = 0;
+    items = NULL;
+cleanup:
+    free(items);
+    free(longs);
+    free(addrs);
+    return rc;
+}
+
+/* Splits value into wide instructions of 24-bit operand */
+static size_t bfr_encode_wide_split(int64_t value, int kind, int32_t off, bft_winstr* dest) {
+    size_t size = 0;
+    while (value != 0) {
+        int64_t part = value > BFD_INT24_MAX ? BFD_INT24_MAX
+            : value < BFD_INT24_MIN ? BFD_INT24_MIN : value;
+        bfr_emit(bfu_wide(kind, part));
+        if (kind == BFO_OUTPUT_AT) bfr_emit((bft_winstr)off);
+        value -= part;
+    }
+    return size;
+}
+
+/* Words of wide operation, only counted without dest */
+static size_t bfr_encode_wide(const bft_ir* ir, const bft_rop* op, size_t target, bft_winstr* dest) {
+    size_t size = 0;
+    switch (op->kind) {
+        case BFO_HALT: case BFO_INPUT: case BFO_MEMSET_ZERO: case BFO_BREAKPOINT:
+            bfr_emit(bfu_wide(op->kind, 0));
+            break;
+        case BFO_CHG: case BFO_SCAN: bfr_emit(bfu_wide(op->kind, op->arg)); break;
+        case BFO_MOV: case BFO_OUTPUT:
+            return bfr_encode_wide_split(op->arg, op->kind, 0, dest);
+        case BFO_OUTPUT_AT:
+            return bfr_encode_wide_split(op->arg, op->kind, op->off, dest);
+        case BFO_JEZ: case BFO_JNZ: bfr_emit(bfu_wide(op->kind, target)); break;
+        case BFO_MOV_JNZ:
+            bfr_emit(bfu_wide(BFO_MOV_JNZ, op->off));
+            bfr_emit(bfu_wide(BFO_JNZ, target));
+            break;
+        case BFO_SET: // second word keeps size of narrow set
+            bfr_emit(bfu_wide(op->kind, (bft_cell)op->arg));
+            bfr_emit((bft_winstr)0);
+            break;
+        case BFO_CHG_AT: case BFO_INPUT_AT: case BFO_CHG_MOV: case BFO_MOV_CHG:
+            bfr_emit(bfu_wide(op->kind, op->arg));
+            bfr_emit((bft_winstr)op->off);
+            break;
+        case BFO_CYCLIC_MOVADD:
+            if (bfr_fits(op->off, INT16_MIN, INT16_MAX)) {
+                bfr_emit(bfu_wide(op->kind, (op->off & BFM_16BIT) << 8 | (bft_cell)op->arg));
+                break;
+            }
+            bfr_emit(bfu_wide(BFO_CYCLIC_MULTI, 1));
+            bfr_emit((bft_winstr)op->off);
+            bfr_emit((bft_winstr)(bft_cell)op->arg);
+            break;
+        case BFO_CYCLIC_MULTI:
+            bfr_emit(bfu_wide(op->kind, op->arg));
+            for (int32_t i = 0; i < op->arg; i++) {
+                bfr_emit((bft_winstr)ir->pool[op->link + i].off);
+                bfr_emit((bft_winstr)ir->pool[op->link + i].value);
+            }
+            break;
+        case BFO_STORE: case BFO_OUTPUT_DATA:
+            bfr_emit(bfu_wide(op->kind, op->arg));
+            if (op->kind == BFO_STORE) bfr_emit((bft_winstr)op->off);
+            for (int32_t i = 0; i < op->arg; i++)
+                bfr_emit((bft_winstr)ir->pool[op->link + i].value);
+            break;
+    }
+    return size;
+}
+
+/* Jumps are absolute, so length of every operation is
+ * known before addresses are */
+static bft_error bfr_lower_wide(const bft_ir* ir, bft_wide_program* prog) {
+    bft_error rc = BFE_OK;
+    size_t* addrs = malloc((ir->count + 1) * sizeof *addrs);
+    bft_winstr* items = NULL;
+    if (!addrs) bfu_throw(BFE_NO_MEMORY);
+
+    addrs[0] = 0;
+    for (size_t i = 0; i < ir->count; i++)
+        addrs[i + 1] = addrs[i] + bfr_encode_wide(ir, ir->ops + i, 0, NULL);
+    if (addrs[ir->count] > BFC_MAX_WIDE_ADDR) bfu_throw(BFE_VERY_LONG_JUMP);
+
+    items = malloc(addrs[ir->count] * sizeof *items);
+    if (!items) bfu_throw(BFE_NO_MEMORY);
+    for (size_t i = 0; i < ir->count; i++) {
+        size_t target = bfr_is_jump(ir->ops[i].kind) ? addrs[ir->ops[i].link + 1] : 0;
+        bfr_encode_wide(ir, ir->ops + i, target, items + addrs[i]);
+    }
+
+    prog->items = items;
+    prog->count = addrs[ir->count];
+    items = NULL;
+cleanup:
+    free(items);
+    free(addrs);
+    return rc;
+}
+
+/* Lifted program goes through passes of level */
+static bft_error bfr_optimize(const bft_program* prog, int level, bft_ir* ir) {
+    static const bft_rpass passes[] = { bfr_fold, bfr_combine, bfr_fuse };
+    static const int levels[] = { 3, 1, 2 };
+
+    bft_error rc = bfr_lift(prog, ir);
+    for (size_t i = 0; i < sizeof passes / sizeof *passes && !rc; i++)
+        if (level >= levels[i]) rc = bfr_run_pass(ir, passes[i]);
+    return rc;
+}
+
+static void bfr_destroy(bft_ir* ir) {
+    free(ir->ops);
+    free(ir->opens);
+    free(ir->pool);
+}
+
+bft_error bfu_optimize(const bft_program* prog, int level, bft_program* result) {
+    bft_ir ir = {0};
+    bft_error rc = bfr_optimize(prog, level, &ir);
+    if (!rc) rc = bfr_lower(&ir, result);
+    bfr_destroy(&ir);
+    return rc;
+}
+
+bft_error bfa_widen(const bft_program* prog, int level, bft_wide_program* wide) {
+    if (!prog || !wide) return BFE_NULL_POINTER;
+
+    bft_ir ir = { .wide = true };
+    bft_error rc = bfr_optimize(prog, level, &ir);
+    if (!rc) rc = bfr_lower_wide(&ir, wide);
+    bfr_destroy(&ir);
+    return rc;
+}
+
+void bfa_wide_destroy(bft_wide_program* wide) {
+    if (!wide) return;
+    free(wide->items);
+}
@@ -0,0 +1,429 @@
+#define _DEFAULT_SOURCE
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define BFD_JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define BFD_JIT_X86_64 0
+#endif
+
+#if BFD_JIT_X86_64
+
+/* Register usage of generated code (System V ABI)
+ * rbx - memory base, r12 - memory cell index,
+ * r13 - state pointer, r14 - memory size. All of them
+ * are callee-saved, so they survive calls to helpers.
+ */
+
+struct bfj_state {
+    bft_cell* mem;
+    size_t mc, pc, size;
+    bft_obuffer output;
+};
+
+typedef bft_error (*bft_jfunc)(struct bfj_state*, const void*);
+
+typedef struct {
+    uint8_t* items;
+    size_t count, capacity;
+} bft_bytes;
+
+typedef struct {
+    size_t pos, target;
+} bft_fixup;
+
+typedef struct {
+    bft_fixup* items;
+    size_t count, capacity;
+} bft_fixups;
+
+static bft_error bfj_reserve(bft_bytes* code, size_t size) {
+    if (code->count + size <= code->capacity) return BFE_OK;
+    while (code->count + size > code->capacity)
+        code->capacity += code->capacity == 0 ? 4096 : code->capacity / 2;
+    uint8_t* items = realloc(code->items, code->capacity);
+    if (!items) return BFE_NO_MEMORY;
+    code->items = items;
+    return BFE_OK;
+}
+
+static void bfj_emit(bft_bytes* code, const void* bytes, size_t size) {
+    memcpy(code->items + code->count, bytes, size);
+    code->count += size;
+}
+
+static void bfj_emit_u8(bft_bytes* code, uint8_t byte) {
+    code->items[code->count++] = byte;
+}
+
+static void bfj_emit_u32(bft_bytes* code, uint32_t value) {
+    bfj_emit(code, &value, sizeof value);
+}
+
+static void bfj_emit_u64(bft_bytes* code, uint64_t value) {
+    bfj_emit(code, &value, sizeof value);
+}
+
+#define bfj_bytes(code, ...) do { \
+    static const uint8_t bytes[] = { __VA_ARGS__ }; \
+    bfj_emit(code, bytes, sizeof bytes); \
+} while (0)
+
+static void bfj_patch_rel32(bft_bytes* code, size_t pos, size_t target) {
+    int32_t rel = (int32_t)(target - (pos + 4));
+    memcpy(code->items + pos, &rel, sizeof rel);
+}
+
+static bft_error bfj_fixup(bft_fixups* fixups, size_t pos, size_t target) {
+    if (fixups->count >= fixups->capacity) {
+        fixups->capacity += fixups->capacity == 0 ? 64 : fixups->capacity / 2;
+        bft_fixup* items = realloc(fixups->items, fixups->capacity * sizeof *items);
+        if (!items) return BFE_NO_MEMORY;
+        fixups->items = items;
+    }
+    fixups->items[fixups->count++] = (bft_fixup){ pos, target };
+    return BFE_OK;
+}
+
+#define BFJ_STATE_MC  offsetof(struct bfj_state, mc)
+#define BFJ_STATE_PC  offsetof(struct bfj_state, pc)
+#define BFJ_STATE_SIZE offsetof(struct bfj_state, size)
+#define BFJ_STATE_OUT offsetof(struct bfj_state, output)
+
+/* mov eax, rc; jmp epilogue */
+static bft_error bfj_emit_return(bft_bytes* code, bft_fixups* fixups, bft_error rc, size_t epilogue) {
+    bfj_emit_u8(code, 0xB8); bfj_emit_u32(code, rc);
+    bfj_emit_u8(code, 0xE9); code->count += 4;
+    return bfj_fixup(fixups, code->count - 4, epilogue);
+}
+
+/* mov qword [r13 + pc], imm32 */
+static void bfj_emit_save_pc(bft_bytes* code, size_t pc) {
+    bfj_bytes(code, 0x49, 0xC7, 0x45, BFJ_STATE_PC);
+    bfj_emit_u32(code, pc);
+}
+
+/* jae error */
+static bft_error bfj_emit_jae(bft_bytes* code, bft_fixups* fixups, size_t target) {
+    bfj_bytes(code, 0x0F, 0x83); code->count += 4;
+    return bfj_fixup(fixups, code->count - 4, target);
+}
+
+/* lea rdx, [r12 + offset]; cmp rdx, r14; jae error */
+static bft_error bfj_emit_cell_at(bft_bytes* code, bft_fixups* fixups, int32_t offset, size_t error) {
+    bfj_bytes(code, 0x49, 0x8D, 0x94, 0x24); bfj_emit_u32(code, offset);
+    bfj_bytes(code, 0x4C, 0x39, 0xF2);
+    return bfj_emit_jae(code, fixups, error);
+}
+
+/* lea rdi, [r13 + output]; mov rax, func; call rax */
+static void bfj_emit_io(bft_bytes* code, void (*func)(void)) {
+    bfj_bytes(code, 0x49, 0x8D, 0xBD); bfj_emit_u32(code, BFJ_STATE_OUT);
+    bfj_bytes(code, 0x48, 0xB8); bfj_emit_u64(code, (uint64_t)(uintptr_t)func);
+    bfj_bytes(code, 0xFF, 0xD0);
+}
+
+/* test al, al; jnz next; mov qword [r13 + pc], pc; return,
+ * so machine is resumed from input when it is available */
+static bft_error bfj_emit_input_check(bft_bytes* code, bft_fixups* fixups, size_t pc, size_t epilogue) {
+    bfj_bytes(code, 0x84, 0xC0, 0x75, 0x00);
+    size_t skip = code->count;
+    bfj_emit_save_pc(code, pc);
+    bft_error rc = bfj_emit_return(code, fixups, BFE_NEED_INPUT, epilogue);
+    code->items[skip - 1] = code->count - skip;
+    return rc;
+}
+
+/* Scan calls bfu_scan only when current cell is nonzero */
+static bft_error bfj_emit_scan(bft_bytes* code, bft_fixups* fixups, int32_t stride, size_t error) {
+    bfj_bytes(code, 0x42, 0x80, 0x3C, 0x23, 0x00);  // cmp byte [rbx + r12], 0
+    bfj_bytes(code, 0x74, 0x00);                    // je skip
+    size_t skip = code->count;
+    bfj_bytes(code, 0x48, 0x89, 0xDF);              // mov rdi, rbx
+    bfj_bytes(code, 0x4C, 0x89, 0xF6);              // mov rsi, r14
+    bfj_bytes(code, 0x4C, 0x89, 0xE2);              // mov rdx, r12
+    bfj_emit_u8(code, 0xB9); bfj_emit_u32(code, stride);         // mov ecx, stride
+    bfj_bytes(code, 0x48, 0xB8);                    // mov rax, bfu_scan
+    bfj_emit_u64(code, (uint64_t)(uintptr_t)bfu_scan);
+    bfj_bytes(code, 0xFF, 0xD0);                    // call rax
+    bfj_bytes(code, 0x48, 0x83, 0xF8, 0xFF);        // cmp rax, -1
+    bfj_bytes(code, 0x0F, 0x84); code->count += 4;  // je error
+    if (bfj_fixup(fixups, code->count - 4, error)) return BFE_NO_MEMORY;
+    bfj_bytes(code, 0x49, 0x89, 0xC4);              // mov r12, rax
+    code->items[skip - 1] = code->count - skip;
+    return BFE_OK;
+}
+
+/* Labels which are not operations, placed after program */
+enum { BFJ_EPILOGUE, BFJ_CORRUPTION, BFJ_LABELS };
+
+static bft_error bfj_translate(bft_jit* jit, const bft_op* ops, bft_bytes* code, bft_fixups* fixups) {
+    size_t count = jit->program->count;
+    size_t epilogue = count + BFJ_EPILOGUE, corruption = count + BFJ_CORRUPTION;
+    size_t* entries = jit->entries;
+    bft_error rc = BFE_OK;
+
+    if (bfj_reserve(code, 32)) return BFE_NO_MEMORY;
+    bfj_bytes(code, 0x55, 0x53, 0x41, 0x54,  // push rbp, rbx, r12
+        0x41, 0x55, 0x41, 0x56);             // push r13, r14
+    bfj_bytes(code, 0x49, 0x89, 0xFD);       // mov r13, rdi
+    bfj_bytes(code, 0x49, 0x8B, 0x5D, offsetof(struct bfj_state, mem));
+    bfj_bytes(code, 0x4D, 0x8B, 0x65, BFJ_STATE_MC);
+    bfj_bytes(code, 0x4D, 0x8B, 0x75, BFJ_STATE_SIZE);
+    bfj_bytes(code, 0xFF, 0xE6);             // jmp rsi
+
+    for (size_t pc = 0; pc < count; pc++) {
+        const bft_op* op = ops + pc;
+        entries[pc] = code->count;
+        if (bfj_reserve(code, 64)) return BFE_NO_MEMORY;
+
+        switch (op->op.kind) {
+            case BFO_CYCLIC_MULTI: {
+                if (bfj_reserve(code, 64 + 48 * op->arg)) return BFE_NO_MEMORY;
+                bfj_bytes(code, 0x42, 0x80, 0x3C, 0x23, 0x00);    // cmp byte [rbx + r12], 0
+                bfj_bytes(code, 0x0F, 0x84); code->count += 4;    // je skip
+                size_t skip = code->count - 4;
+                for (int32_t i = 1; i <= op->arg; i++)
+                    if (bfj_emit_cell_at(code, fixups, op[i].off, corruption))
+                        return BFE_NO_MEMORY;
+                bfj_bytes(code, 0x42, 0x0F, 0xB6, 0x0C, 0x23);    // movzx ecx, byte [rbx + r12]
+                for (int32_t i = 1; i <= op->arg; i++) {
+                    bfj_bytes(code, 0x49, 0x8D, 0x94, 0x24); bfj_emit_u32(code, op[i].off);
+                    bfj_bytes(code, 0x69, 0xC1); bfj_emit_u32(code, op[i].arg); // imul eax, ecx, coef
+                    bfj_bytes(code, 0x00, 0x04, 0x13);            // add byte [rbx + rdx], al
+                }
+                bfj_bytes(code, 0x42, 0xC6, 0x04, 0x23, 0x00);    // mov byte [rbx + r12], 0
+                bfj_patch_rel32(code, skip, code->count);
+            } break;
+            case BFO_CHG: // add byte [rbx + r12], imm8
+                bfj_bytes(code, 0x42, 0x80, 0x04, 0x23);
+                bfj_emit_u8(code, op->arg);
+                break;
+            case BFO_CHG_AT: // add byte [rbx + rdx], imm8
+                rc = bfj_emit_cell_at(code, fixups, op->off, corruption);
+                bfj_bytes(code, 0x80, 0x04, 0x13);
+                bfj_emit_u8(code, op->arg);
+                break;
+            case BFO_INPUT_AT:
+                rc = bfj_emit_cell_at(code, fixups, op->off, corruption);
+                bfj_bytes(code, 0x48, 0x8D, 0x34, 0x13); // lea rsi, [rbx + rdx]
+                bfj_emit_io(code, (void (*)(void))bfu_input);
+                if (!rc) rc = bfj_emit_input_check(code, fixups, pc, epilogue);
+                break;
+            case BFO_OUTPUT_AT:
+                rc = bfj_emit_cell_at(code, fixups, op->off, corruption);
+                bfj_bytes(code, 0x0F, 0xB6, 0x34, 0x13);              // movzx esi, byte [rbx + rdx]
+                bfj_emit_u8(code, 0xBA); bfj_emit_u32(code, op->arg); // mov edx, count
+                bfj_emit_io(code, (void (*)(void))bfu_output);
+                break;
+            case BFO_MOV: // add r12, imm32; cmp r12, r14; jae error
+                bfj_bytes(code, 0x49, 0x81, 0xC4); bfj_emit_u32(code, op->arg);
+                bfj_bytes(code, 0x4D, 0x39, 0xF4);
+                rc = bfj_emit_jae(code, fixups, corruption);
+                break;
+            case BFO_SET: // mov byte [rbx + r12], imm8
+                bfj_bytes(code, 0x42, 0xC6, 0x04, 0x23);
+                bfj_emit_u8(code, op->arg);
+                break;
+            case BFO_CHG_MOV: // add byte [rbx + r12], imm8; then as move
+                bfj_bytes(code, 0x42, 0x80, 0x04, 0x23);
+                bfj_emit_u8(code, op->arg);
+                bfj_bytes(code, 0x49, 0x81, 0xC4); bfj_emit_u32(code, op->off);
+                bfj_bytes(code, 0x4D, 0x39, 0xF4);
+                rc = bfj_emit_jae(code, fixups, corruption);
+                break;
+            case BFO_MOV_CHG: // as move; then add byte [rbx + r12], imm8
+                bfj_bytes(code, 0x49, 0x81, 0xC4); bfj_emit_u32(code, op->off);
+                bfj_bytes(code, 0x4D, 0x39, 0xF4);
+                rc = bfj_emit_jae(code, fixups, corruption);
+                bfj_bytes(code, 0x42, 0x80, 0x04, 0x23);
+                bfj_emit_u8(code, op->arg);
+                break;
+            case BFO_STORE: // mov byte [rbx + rdx + i], imm8
+                if (bfj_reserve(code, 64 + 8 * op->arg)) return BFE_NO_MEMORY;
+                rc = bfj_emit_cell_at(code, fixups, op->off + op->arg - 1, corruption);
+                if (!rc) rc = bfj_emit_cell_at(code, fixups, op->off, corruption);
+                for (int32_t i = 0; i < op->arg; i++) {
+                    bfj_bytes(code, 0xC6, 0x84, 0x13); bfj_emit_u32(code, i);
+                    bfj_emit_u8(code, op[2 + i].arg);
+                }
+                break;
+            case BFO_OUTPUT_DATA:
+                if (bfj_reserve(code, 64 + 32 * op->arg)) return BFE_NO_MEMORY;
+                for (int32_t i = 0; i < op->arg; i++) {
+                    bfj_emit_u8(code, 0xBE); bfj_emit_u32(code, (bft_cell)op[1 + i].arg); // mov esi, cell
+                    bfj_emit_u8(code, 0xBA); bfj_emit_u32(code, 1);                       // mov edx, 1
+                    bfj_emit_io(code, (void (*)(void))bfu_output);
+                }
+                break;
+            case BFO_MOV_JNZ: // as move, following jump is translated as is
+                bfj_bytes(code, 0x49, 0x81, 0xC4); bfj_emit_u32(code, op->off);
+                bfj_bytes(code, 0x4D, 0x39, 0xF4);
+                rc = bfj_emit_jae(code, fixups, corruption);
+                break;
+            case BFO_JEZ: case BFO_JNZ: // cmp byte [rbx + r12], 0; je/jne target
+                bfj_bytes(code, 0x42, 0x80, 0x3C, 0x23, 0x00);
+                bfj_emit_u8(code, 0x0F);
+                bfj_emit_u8(code, op->op.kind == BFO_JEZ ? 0x84 : 0x85);
+                code->count += 4;
+                rc = bfj_fixup(fixups, code->count - 4, op->arg);
+                break;
+            case BFO_INPUT:
+                bfj_bytes(code, 0x4A, 0x8D, 0x34, 0x23); // lea rsi, [rbx + r12]
+                bfj_emit_io(code, (void (*)(void))bfu_input);
+                rc = bfj_emit_input_check(code, fixups, pc, epilogue);
+                break;
+            case BFO_OUTPUT:
+                bfj_bytes(code, 0x42, 0x0F, 0xB6, 0x34, 0x23);    // movzx esi, byte [rbx + r12]
+                bfj_emit_u8(code, 0xBA); bfj_emit_u32(code, op->arg); // mov edx, count
+                bfj_emit_io(code, (void (*)(void))bfu_output);
+                break;
+            case BFO_MEMSET_ZERO: // mov byte [rbx + r12], 0
+                bfj_bytes(code, 0x42, 0xC6, 0x04, 0x23, 0x00);
+                break;
+            case BFO_SCAN:
+                rc = bfj_emit_scan(code, fixups, op->arg, corruption);
+                break;
+            case BFO_CYCLIC_MOVADD: {
+                bfj_bytes(code, 0x42, 0x80, 0x3C, 0x23, 0x00);    // cmp byte [rbx + r12], 0
+                bfj_bytes(code, 0x0F, 0x84); code->count += 4;    // je skip
+                size_t skip = code->count - 4;
+                if (bfj_emit_cell_at(code, fixups, op->off, corruption)) return BFE_NO_MEMORY;
+                bfj_bytes(code, 0x42, 0x0F, 0xB6, 0x04, 0x23);    // movzx eax, byte [rbx + r12]
+                bfj_bytes(code, 0x69, 0xC0); bfj_emit_u32(code, op->arg); // imul eax, eax, coef
+                bfj_bytes(code, 0x00, 0x04, 0x13);                // add byte [rbx + rdx], al
+                bfj_bytes(code, 0x42, 0xC6, 0x04, 0x23, 0x00);    // mov byte [rbx + r12], 0
+                bfj_patch_rel32(code, skip, code->count);
+            } break;
+            case BFO_BREAKPOINT:
+                bfj_emit_save_pc(code, pc + 1);
+                rc = bfj_emit_return(code, fixups, BFE_BREAKPOINT, epilogue);
+                break;
+            case BFO_HALT:
+                bfj_emit_save_pc(code, pc);
+                rc = bfj_emit_return(code, fixups, BFE_OK, epilogue);
+                break;
+            case BFO_UNKNOWN:
+                bfj_emit_save_pc(code, pc);
+                rc = bfj_emit_return(code, fixups, BFE_UNKNOWN_INSTR, epilogue);
+                break;
+            case BFO_NOP:
+                break;
+            default:
+                return BFE_UNKNOWN_INSTR;
+        }
+        if (rc) return rc;
+    }
+
+    if (bfj_reserve(code, 64)) return BFE_NO_MEMORY;
+    size_t labels[BFJ_LABELS];
+
+    labels[BFJ_CORRUPTION] = code->count;
+    bfj_emit_u8(code, 0xB8); bfj_emit_u32(code, BFE_MEMORY_CORRUPTION);
+
+    labels[BFJ_EPILOGUE] = code->count;
+    bfj_bytes(code, 0x4D, 0x89, 0x65, BFJ_STATE_MC); // mov [r13 + mc], r12
+    bfj_bytes(code, 0x41, 0x5E, 0x41, 0x5D,          // pop r14, r13
+        0x41, 0x5C, 0x5B, 0x5D, 0xC3);               // pop r12, rbx, rbp; ret
+
+    for (size_t i = 0; i < fixups->count; i++) {
+        size_t target = fixups->items[i].target;
+        target = target < count ? entries[target] : labels[target - count];
+        bfj_patch_rel32(code, fixups->items[i].pos, target);
+    }
+
+    return BFE_OK;
+}
+
+bft_error bfa_jit_compile(bft_jit* jit, bft_program* prog) {
+    if (!jit || !prog) return BFE_NULL_POINTER;
+    *jit = (bft_jit){ prog, NULL, 0, NULL };
+
+    bft_error rc = BFE_OK;
+    bft_bytes code[1] = {0};
+    bft_fixups fixups[1] = {0};
+
+    bft_op* ops = bfu_decode(prog);
+    jit->entries = malloc(prog->count * sizeof *jit->entries);
+    if (!ops || !jit->entries) bfu_throw(BFE_NO_MEMORY);
+
+    rc = bfj_translate(jit, ops, code, fixups);
+    if (rc) goto cleanup;
+
+    void* exec = mmap(NULL, code->count, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (exec == MAP_FAILED) bfu_throw(BFE_NO_MEMORY);
+    memcpy(exec, code->items, code->count);
+    if (mprotect(exec, code->count, PROT_READ | PROT_EXEC)) {
+        munmap(exec, code->count);
+        bfu_throw(BFE_NO_MEMORY);
+    }
+    jit->code = exec;
+    jit->size = code->count;
+
+cleanup:
+    if (rc) { free(jit->entries); jit->entries = NULL; }
+    free(fixups->items);
+    free(code->items);
+    free(ops);
+    return rc;
+}
+
+bft_error bfa_jit_execute(bft_jit* jit, bft_env* env, bft_context* ext_ctx) {
+    if (!jit || !jit->program || !env) return BFE_NULL_POINTER;
+    if (!jit->code) return bfa_execute(jit->program, env, ext_ctx);
+    if (!bfu_valid_env(env)) return BFE_INVALID_ENV;
+
+    bft_context ctx;
+    bft_error rc = bfu_tape_acquire(&ctx, ext_ctx);
+    if (rc) return rc;
+
+    struct bfj_state state;
+    state.mem = ctx.mem; state.mc = ctx.mc; state.pc = ctx.pc;
+    state.size = ctx.size;
+    state.output.env = env; state.output.count = 0;
+    const uint8_t* entry = (const uint8_t*)jit->code + jit->entries[ctx.pc];
+    bft_jfunc func; memcpy(&func, &jit->code, sizeof func);
+    rc = ctx.mc < ctx.size ? func(&state, entry) : BFE_MEMORY_CORRUPTION;
+    bfu_flush(&state.output);
+
+    ctx.mc = state.mc;
+    ctx.pc = state.pc;
+    if (bfu_suspended(rc) && ext_ctx)
+        *ext_ctx = ctx;
+    else
+        bfu_tape_release(&ctx);
+    return rc;
+}
+
+void bfa_jit_destroy(bft_jit* jit) {
+    if (!jit) return;
+    if (jit->code) munmap(jit->code, jit->size);
+    free(jit->entries);
+    *jit = (bft_jit){0};
+}
+
+#else // not BFD_JIT_X86_64
+
+bft_error bfa_jit_compile(bft_jit* jit, bft_program* prog) {
+    if (!jit || !prog) return BFE_NULL_POINTER;
+    *jit = (bft_jit){ prog, NULL, 0, NULL };
+    return BFE_OK;
+}
+
+bft_error bfa_jit_execute(bft_jit* jit, bft_env* env, bft_context* ctx) {
+    if (!jit || !jit->program) return BFE_NULL_POINTER;
+    return bfa_execute(jit->program, env, ctx);
+}
+
+void bfa_jit_destroy(bft_jit* jit) {
+    if (jit) *jit = (bft_jit){0};
+}
+
+#endif // BFD_JIT_X86_64
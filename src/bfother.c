@@ -1,4 +1,5 @@
 #include "brainfuck.h"
+#include "bfcommon.h"
 #include <stdlib.h>
 
 const char* bfa_strerror(bft_error error) {
@@ -17,10 +18,17 @@ const char* bfa_strerror(bft_error error) {
         case BFE_INVALID_ENV: return "invalid values in environment";
         case BFE_UNKNOWN_INSTR: return "unknown instruction";
         case BFE_MEMORY_CORRUPTION: return "memory corruption";
+        case BFE_FILE_ERROR: return "cannot access program file";
+        case BFE_INVALID_FORMAT: return "invalid format of program file";
+        case BFE_YIELD: return "budget of steps is used up";
+        case BFE_NEED_INPUT: return "input is not available yet";
+        case BFE_PROGRAM_MISMATCH: return "checkpoint belongs to other program";
     }
 #pragma GCC diagnostic pop
 }
 
 void bfa_destroy(bft_program* prog) {
-    if (prog) free(prog->items);
+    if (!prog) return;
+    if (prog->map) bfu_unmap_program(prog);
+    else free(prog->items);
 }
\ No newline at end of file
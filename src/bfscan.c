@@ -0,0 +1,128 @@
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__SSE2__))
+#define BFD_SCAN_SIMD 1
+#include <immintrin.h>
+#else
+#define BFD_SCAN_SIMD 0
+#endif
+
+#define BFS_NOT_FOUND ((size_t)-1)
+
+static size_t bfs_scan_scalar(const bft_cell* mem, size_t size, size_t mc, int32_t stride) {
+    while (mc < size) {
+        if (mem[mc] == 0) return mc;
+        mc += stride;
+    }
+    return BFS_NOT_FOUND;
+}
+
+#if BFD_SCAN_SIMD
+
+/*
+ * Vector kernels compare whole block of cells with zero
+ * and keep only bits of cells visited by strided scan.
+ * Pattern has bits at every stride position, mask of
+ * block is pattern shifted by phase of block start.
+ * Remaining cells after last whole block are scanned
+ * one by one from first visited position.
+ */
+
+static uint64_t bfs_pattern(int32_t stride) {
+    uint64_t pattern = 0;
+    for (int bit = 0; bit < 64; bit += stride)
+        pattern |= (uint64_t)1 << bit;
+    return pattern;
+}
+
+#define BFS_DEFINE_KERNELS(name, width, zeros, attr)                            \
+attr static size_t name##_rt(const bft_cell* mem, size_t size, size_t mc, int32_t stride) { \
+    uint64_t pattern = bfs_pattern(stride);                                     \
+    int32_t phase = 0, step = width % stride;                                   \
+    size_t pos = mc;                                                            \
+    for (; pos + width <= size; pos += width) {                                 \
+        uint32_t found = zeros(mem + pos) & (uint32_t)(pattern << phase);       \
+        if (found) return pos + __builtin_ctz(found);                           \
+        phase = (phase + stride - step) % stride;                               \
+    }                                                                           \
+    return bfs_scan_scalar(mem, size, pos + phase, stride);                     \
+}                                                                               \
+attr static size_t name##_lt(const bft_cell* mem, size_t mc, int32_t stride) {       \
+    uint64_t pattern = bfs_pattern(stride) << (63 - (63 / stride) * stride);    \
+    int32_t phase = 0, step = width % stride;                                   \
+    size_t end = mc + 1;                                                        \
+    for (; end >= width; end -= width) {                                        \
+        uint32_t mask = (uint32_t)(pattern >> phase >> (64 - width));           \
+        uint32_t found = zeros(mem + end - width) & mask;                       \
+        if (found) return end - width + 31 - __builtin_clz(found);              \
+        phase = (phase + stride - step) % stride;                               \
+    }                                                                           \
+    for (size_t pos = end - 1 - phase; (size_t)phase < end; pos -= stride) {    \
+        if (mem[pos] == 0) return pos;                                          \
+        if (pos < (size_t)stride) break;                                        \
+    }                                                                           \
+    return BFS_NOT_FOUND;                                                       \
+}
+
+static inline uint32_t bfs_zeros_sse2(const bft_cell* cells) {
+    __m128i block = _mm_loadu_si128((const __m128i*)cells);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128()));
+}
+
+BFS_DEFINE_KERNELS(bfs_sse2, 16, bfs_zeros_sse2, )
+
+#if defined(__x86_64__)
+#define BFD_SCAN_AVX2 1
+
+__attribute__((target("avx2")))
+static inline uint32_t bfs_zeros_avx2(const bft_cell* cells) {
+    __m256i block = _mm256_loadu_si256((const __m256i*)cells);
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+}
+
+BFS_DEFINE_KERNELS(bfs_avx2, 32, bfs_zeros_avx2, __attribute__((target("avx2"))))
+
+static int bfs_has_avx2(void) {
+    static int support = -1;
+    if (support < 0) {
+        __builtin_cpu_init();
+        support = __builtin_cpu_supports("avx2") != 0;
+    }
+    return support;
+}
+#else
+#define BFD_SCAN_AVX2 0
+#endif
+
+#endif
+
+size_t bfu_scan(const bft_cell* mem, size_t size, size_t mc, int32_t stride) {
+    if (mc >= size) return BFS_NOT_FOUND;
+
+    if (stride == 1) {
+        const bft_cell* zero = memchr(mem + mc, 0, size - mc);
+        return zero ? (size_t)(zero - mem) : BFS_NOT_FOUND;
+    }
+
+#if BFD_SCAN_SIMD
+#if BFD_SCAN_AVX2
+    if (bfu_abs(stride) <= 32 && bfs_has_avx2())
+        return stride > 0
+            ? bfs_avx2_rt(mem, size, mc, stride)
+            : bfs_avx2_lt(mem, mc, -stride);
+#endif
+    if (bfu_abs(stride) <= 16)
+        return stride > 0
+            ? bfs_sse2_rt(mem, size, mc, stride)
+            : bfs_sse2_lt(mem, mc, -stride);
+#endif
+
+    if (stride > 0) return bfs_scan_scalar(mem, size, mc, stride);
+    while (mem[mc] != 0) {
+        if (mc < (size_t)-stride) return BFS_NOT_FOUND;
+        mc += stride;
+    }
+    return mc;
+}
@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+#include "brainfuck.h"
+#include "bfcommon.h"
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__unix__) || defined(__APPLE__))
+#define BFD_TAPE_MMAP 1
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define BFD_TAPE_MMAP 0
+#endif
+
+bft_error bfu_tape_acquire(bft_context* ctx, const bft_context* ext_ctx) {
+    if (ext_ctx && ext_ctx->mem) {
+        *ctx = *ext_ctx;
+        ctx->size = bfu_context_size(ctx);
+        return BFE_OK;
+    }
+    *ctx = (bft_context){0};
+    ctx->mem = calloc(BFC_MAX_MEMORY, sizeof *ctx->mem);
+    ctx->size = BFC_MAX_MEMORY;
+    return ctx->mem ? BFE_OK : BFE_NO_MEMORY;
+}
+
+void bfu_tape_release(bft_context* ctx) {
+    if (!(ctx->flags & BFF_TAPE_EXTERNAL)) free(ctx->mem);
+}
+
+#if BFD_TAPE_MMAP
+
+/*
+ * Tape is placed between two inaccessible regions of
+ * BFD_TAPE_GUARD bytes, its size is rounded up to pages,
+ * so any access outside of tape up to guard size away
+ * raises SIGSEGV (or SIGBUS). Handler jumps back to
+ * bfu_guarded only when fault address is inside guarded
+ * region of current thread, other faults are passed
+ * to previous handler.
+ */
+
+typedef struct bft_guard {
+    const char *begin, *end;
+    sigjmp_buf jump;
+} bft_guard;
+
+static __thread bft_guard* bfu_active_guard;
+static struct sigaction bfu_prev_segv, bfu_prev_bus;
+static pthread_once_t bfu_handler_once = PTHREAD_ONCE_INIT;
+
+static void bfu_fault_handler(int sig, siginfo_t* info, void* uctx) {
+    bft_guard* guard = bfu_active_guard;
+    const char* addr = info->si_addr;
+    if (guard && guard->begin <= addr && addr < guard->end)
+        siglongjmp(guard->jump, 1);
+
+    struct sigaction* prev = sig == SIGSEGV ? &bfu_prev_segv : &bfu_prev_bus;
+    /**/ if (prev->sa_flags & SA_SIGINFO)
+        prev->sa_sigaction(sig, info, uctx);
+    else if (prev->sa_handler == SIG_DFL || prev->sa_handler == SIG_IGN)
+        signal(sig, SIG_DFL); // fault repeats after return
+    else
+        prev->sa_handler(sig);
+}
+
+static void bfu_install_handler(void) {
+    struct sigaction action = {0};
+    action.sa_sigaction = bfu_fault_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &bfu_prev_segv);
+    sigaction(SIGBUS,  &action, &bfu_prev_bus);
+}
+
+bft_error bfu_guarded(const bft_context* ctx, bft_error (*func)(void*), void* data) {
+    if (!(ctx->flags & BFF_TAPE_GUARDED)) return func(data);
+    pthread_once(&bfu_handler_once, bfu_install_handler);
+
+    bft_guard guard, *prev = bfu_active_guard;
+    guard.begin = (const char*)ctx->mem - BFD_TAPE_GUARD;
+    guard.end   = (const char*)(ctx->mem + ctx->size) + BFD_TAPE_GUARD;
+    if (sigsetjmp(guard.jump, 1)) {
+        bfu_active_guard = prev;
+        return BFE_MEMORY_CORRUPTION;
+    }
+
+    bfu_active_guard = &guard;
+    bft_error rc = func(data);
+    bfu_active_guard = prev;
+    return rc;
+}
+
+bft_error bfa_tape_create(bft_context* ctx, size_t size) {
+    if (!ctx) return BFE_NULL_POINTER;
+    *ctx = (bft_context){0};
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (size == 0) size = BFC_MAX_MEMORY;
+    if (size > (SIZE_MAX - 2 * BFD_TAPE_GUARD - page) / sizeof(bft_cell))
+        return BFE_NO_MEMORY;
+    size_t bytes = (size * sizeof(bft_cell) + page - 1) / page * page;
+
+    char* base = mmap(NULL, bytes + 2 * BFD_TAPE_GUARD, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return BFE_NO_MEMORY;
+    if (mprotect(base + BFD_TAPE_GUARD, bytes, PROT_READ | PROT_WRITE)) {
+        munmap(base, bytes + 2 * BFD_TAPE_GUARD);
+        return BFE_NO_MEMORY;
+    }
+
+    ctx->mem = (bft_cell*)(base + BFD_TAPE_GUARD);
+    ctx->size = bytes / sizeof(bft_cell);
+    ctx->flags = BFF_TAPE_EXTERNAL | BFF_TAPE_GUARDED;
+    return BFE_OK;
+}
+
+void bfa_tape_destroy(bft_context* ctx) {
+    if (!ctx || !ctx->mem) return;
+    if (ctx->flags & BFF_TAPE_GUARDED)
+        munmap((char*)ctx->mem - BFD_TAPE_GUARD,
+            ctx->size * sizeof(bft_cell) + 2 * BFD_TAPE_GUARD);
+    else
+        free(ctx->mem);
+    *ctx = (bft_context){0};
+}
+
+#else // not BFD_TAPE_MMAP
+
+bft_error bfu_guarded(const bft_context* ctx, bft_error (*func)(void*), void* data) {
+    (void)ctx;
+    return func(data);
+}
+
+bft_error bfa_tape_create(bft_context* ctx, size_t size) {
+    if (!ctx) return BFE_NULL_POINTER;
+    *ctx = (bft_context){0};
+    if (size == 0) size = BFC_MAX_MEMORY;
+    ctx->mem = calloc(size, sizeof *ctx->mem);
+    if (!ctx->mem) return BFE_NO_MEMORY;
+    ctx->size = size;
+    ctx->flags = BFF_TAPE_EXTERNAL;
+    return BFE_OK;
+}
+
+void bfa_tape_destroy(bft_context* ctx) {
+    if (!ctx) return;
+    free(ctx->mem);
+    *ctx = (bft_context){0};
+}
+
+#endif // BFD_TAPE_MMAP